@@ -0,0 +1,65 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/*
+A queue that connects two threads. push() blocks while the queue holds the maximum number of elements, so a producer
+can not get further ahead of its consumer than that. After close() has been called, pop() returns the remaining elements
+and then reports that the queue is exhausted.
+*/
+template<typename T>
+class BoundedQueue {
+
+	std::deque<T> elements;
+	size_t capacity;
+	bool closed = false;
+
+	std::mutex mutex;
+	std::condition_variable not_full;
+	std::condition_variable not_empty;
+
+public:
+	explicit BoundedQueue(size_t capacity) :
+		capacity(capacity) {}
+
+	/*
+	Appends an element, waiting until there is room for it.
+	*/
+	void push(T element) {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]() { return elements.size() < capacity; });
+		elements.push_back(std::move(element));
+		not_empty.notify_one();
+	}
+
+	/*
+	Removes the first element and stores it in element, waiting until one is available.
+	Returns false if the queue has been closed and there are no elements left.
+	*/
+	bool pop(T &element) {
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]() { return !elements.empty() || closed; });
+		if (elements.empty())
+			return false;
+		element = std::move(elements.front());
+		elements.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	/*
+	Signals that no more elements will be pushed.
+	*/
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "BranchScan.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BRANCH_SCAN_SSE2
+#endif
+
+//All branch instructions with an address operand have an opcode of at least this value
+#define MIN_BRANCH_OPCODE 0xc2
+
+/*
+Marks every opcode of a branch instruction with an address operand.
+*/
+struct BranchOpcodes {
+	bool table[256];
+
+	BranchOpcodes() {
+		for (int i = 0; i < 256; i++)
+			table[i] = instructions8085[i].instruction_type == BRANCH && instructions8085[i].operand_length == 2;
+	}
+};
+
+/*
+Adds the branch at offset i to the sites, if there is one.
+*/
+static inline void check_offset(const DecoderInput &input, const bool *is_branch, unsigned int i, std::vector<BranchSite> &sites) {
+	const uint8_t *rom = input.rom_begin;
+	if (is_branch[rom[i]] && i + 2 < input.size())
+		sites.push_back(BranchSite(input.base_address + i, rom[i + 1] | (rom[i + 2] << 8)));
+}
+
+std::vector<BranchSite> scan_branches(const DecoderInput &input) {
+	static const BranchOpcodes opcodes;
+	const bool *is_branch = opcodes.table;
+	unsigned int length = input.size();
+	unsigned int i = 0;
+	std::vector<BranchSite> sites;
+
+#ifdef BRANCH_SCAN_SSE2
+	//Most bytes are below the smallest branch opcode, so 16 bytes at a time are compared against it
+	//and only the offsets that pass are looked up in the table.
+	const __m128i min_opcode = _mm_set1_epi8((char)MIN_BRANCH_OPCODE);
+	for (; i + 16 <= length; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)(input.rom_begin + i));
+		__m128i above = _mm_cmpeq_epi8(_mm_max_epu8(bytes, min_opcode), bytes);
+		unsigned int mask = (unsigned int)_mm_movemask_epi8(above);
+		for (unsigned int j = i; mask != 0; j++, mask >>= 1) {
+			if (mask & 1)
+				check_offset(input, is_branch, j, sites);
+		}
+	}
+#endif
+
+	for (; i < length; i++) {
+		if (input.rom_begin[i] >= MIN_BRANCH_OPCODE)
+			check_offset(input, is_branch, i, sites);
+	}
+
+	return sites;
+}
@@ -0,0 +1,27 @@
+#ifndef BRANCH_SCAN_H
+#define BRANCH_SCAN_H
+
+#include <vector>
+
+#include "Decoder.h"
+
+/*
+A branch instruction with a fixed target address that was found by scan_branches().
+*/
+struct BranchSite {
+	unsigned int address;
+	unsigned int target;
+
+	BranchSite(unsigned int address, unsigned int target) :
+		address(address),
+		target(target) {}
+};
+
+/*
+Scans the input for JMP, CALL and their conditional variants at every offset, without decoding the instructions in between.
+Since data and operands are scanned as well, the result is a superset of the branches that the Decoder finds.
+The sites are returned in address order.
+*/
+std::vector<BranchSite> scan_branches(const DecoderInput &input);
+
+#endif
\ No newline at end of file
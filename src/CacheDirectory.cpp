@@ -0,0 +1,196 @@
+#include "CacheDirectory.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#else
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#endif
+
+#include "util.h"
+
+//Has to change whenever the layout of an entry changes, or the results that are stored in it
+#define CACHE_VERSION 3
+
+//Entries are named after their key, as 16 hexadecimal digits followed by an extension of this length that starts with ".dsm"
+#define CACHE_EXTENSION_LENGTH 5
+#define CACHE_NAME_LENGTH (16 + CACHE_EXTENSION_LENGTH)
+
+//"DSM85C" followed by the version as two bytes, read as a little-endian value
+#define CACHE_MAGIC (0x00004335384d5344ull | (uint64_t)CACHE_VERSION << 48)
+
+std::string CacheDirectory::entry_path(uint64_t key, const char *extension) const {
+	std::string name;
+	for (int shift = 60; shift >= 0; shift -= 4)
+		name += hex_digits[(key >> shift) & 0xf];
+	return directory + "/" + name + extension;
+}
+
+/*
+Creates the directory and all missing parent directories. Returns false if the directory does not exist afterwards.
+*/
+bool CacheDirectory::create_directory() const {
+	for (size_t separator = 1; separator <= directory.length(); separator++) {
+		if (separator < directory.length() && directory[separator] != '/' && directory[separator] != '\\')
+			continue;
+		//Failures are only checked for the whole path, since parents usually exist already
+		std::string path = directory.substr(0, separator);
+#ifndef _WIN32
+		mkdir(path.c_str(), 0777);
+#else
+		_mkdir(path.c_str());
+#endif
+	}
+
+#ifndef _WIN32
+	struct stat st;
+	return stat(directory.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#else
+	DWORD attributes = GetFileAttributesA(directory.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#endif
+}
+
+bool CacheDirectory::load(uint64_t key, const char *extension, RomImage &entry, CacheReader &contents) const {
+	if (!enabled())
+		return false;
+
+	std::string path = entry_path(key, extension);
+	if (!entry.open(path))
+		return false;
+
+	//Mark the entry as recently used, so it is not evicted
+#ifndef _WIN32
+	utime(path.c_str(), nullptr);
+#else
+	_utime(path.c_str(), nullptr);
+#endif
+
+	contents = CacheReader(entry.data(), entry.data() + entry.size());
+	uint64_t magic = contents.read_u64();
+	uint64_t entry_key = contents.read_u64();
+	return contents.good() && magic == CACHE_MAGIC && entry_key == key;
+}
+
+void CacheDirectory::store(uint64_t key, const char *extension, const CacheWriter &contents) const {
+	if (!enabled())
+		return;
+
+	//Every store writes its own temporary file, so threads and concurrent runs storing the same entry do not interfere
+	static std::atomic<unsigned int> next_temp_file(0);
+	std::string path = entry_path(key, extension);
+#ifndef _WIN32
+	std::string temp_path = path + "." + std::to_string(getpid());
+#else
+	std::string temp_path = path + "." + std::to_string(_getpid());
+#endif
+	temp_path += "." + std::to_string(next_temp_file++) + ".tmp";
+	{
+		std::ofstream out(temp_path, std::ios_base::out | std::ios_base::binary);
+		if (!out && create_directory())
+			out.open(temp_path, std::ios_base::out | std::ios_base::binary);
+		if (!out) {
+			if (!warned.exchange(true))
+				std::cerr << "Warning: Cache directory can not be written: " << directory << std::endl;
+			return;
+		}
+
+		CacheWriter header;
+		header.write_u64(CACHE_MAGIC);
+		header.write_u64(key);
+		out.write(header.contents().data(), header.contents().length());
+		out.write(contents.contents().data(), contents.contents().length());
+
+		if (!out) {
+			out.close();
+			std::remove(temp_path.c_str());
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0)
+		std::remove(temp_path.c_str());
+}
+
+/*
+Checks whether a file name has the form of a cache entry.
+*/
+static bool is_entry_name(const std::string &name) {
+	if (name.length() != CACHE_NAME_LENGTH || name.compare(16, 4, ".dsm") != 0)
+		return false;
+	for (size_t i = 0; i < 16; i++) {
+		if (!std::isxdigit((unsigned char)name[i]))
+			return false;
+	}
+	return true;
+}
+
+void CacheDirectory::evict() const {
+	if (!enabled())
+		return;
+
+	struct Entry {
+		std::string path;
+		long long used;	//Time of the last use
+		unsigned long long size;
+	};
+	std::vector<Entry> entries;
+	unsigned long long total_size = 0;
+
+#ifndef _WIN32
+	DIR *dir = opendir(directory.c_str());
+	if (!dir)
+		return;
+	while (struct dirent *file = readdir(dir)) {
+		std::string name = file->d_name;
+		struct stat st;
+		if (is_entry_name(name) && stat((directory + "/" + name).c_str(), &st) == 0) {
+			long long used = (long long)st.st_mtime;
+#ifdef __linux__
+			used = used * 1000000000ll + st.st_mtim.tv_nsec;
+#endif
+			entries.push_back(Entry{ directory + "/" + name, used, (unsigned long long)st.st_size });
+			total_size += (unsigned long long)st.st_size;
+		}
+	}
+	closedir(dir);
+#else
+	WIN32_FIND_DATAA file;
+	HANDLE find = FindFirstFileA((directory + "/*.dsm?").c_str(), &file);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		std::string name = file.cFileName;
+		long long used = (long long)file.ftLastWriteTime.dwHighDateTime << 32 | file.ftLastWriteTime.dwLowDateTime;
+		unsigned long long size = (unsigned long long)file.nFileSizeHigh << 32 | file.nFileSizeLow;
+		if (is_entry_name(name)) {
+			entries.push_back(Entry{ directory + "/" + name, used, size });
+			total_size += size;
+		}
+	} while (FindNextFileA(find, &file));
+	FindClose(find);
+#endif
+
+	if (total_size <= CACHE_MAX_SIZE)
+		return;
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.used < b.used;
+	});
+	for (size_t i = 0; i < entries.size() && total_size > CACHE_MAX_SIZE; i++) {
+		if (std::remove(entries[i].path.c_str()) == 0)
+			total_size -= entries[i].size;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,217 @@
+#ifndef CACHE_DIRECTORY_H
+#define CACHE_DIRECTORY_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "RomImage.h"
+
+//Size that the entries in a cache directory are limited to, in bytes
+#define CACHE_MAX_SIZE (128ull * 1024 * 1024)
+
+/*
+Fast 64 bit hash for the keys of cache entries. The input is processed in words of 8 bytes, which are read in the byte order of
+the machine, so hashes are not portable between machines with different byte orders. Not meant to withstand deliberate collisions.
+*/
+class Hash {
+	uint64_t state = 0xcbf29ce484222325ull;
+
+	void mix(uint64_t word) {
+		state = (state ^ word) * 0x9e3779b97f4a7c15ull;
+		state ^= state >> 29;
+	}
+
+public:
+	void add(const void *data, size_t length) {
+		const uint8_t *bytes = (const uint8_t *)data;
+		size_t i = 0;
+		for (; i + 8 <= length; i += 8) {
+			uint64_t word;
+			std::memcpy(&word, bytes + i, 8);
+			mix(word);
+		}
+		//The length is part of the last word, so inputs that only differ in trailing zeros have different hashes
+		uint64_t last = 0;
+		if (i < length)
+			std::memcpy(&last, bytes + i, length - i);
+		mix(last ^ (uint64_t)length << 56);
+	}
+
+	void add(uint64_t value) {
+		mix(value);
+	}
+
+	void add(const std::string &str) {
+		add(str.data(), str.length());
+	}
+
+	uint64_t value() const {
+		return state;
+	}
+};
+
+/*
+Builds the contents of a cache entry. Values are written in little-endian byte order.
+*/
+class CacheWriter {
+	std::string bytes;
+
+public:
+	void write_u8(uint8_t value) {
+		bytes += (char)value;
+	}
+
+	void write_u32(uint32_t value) {
+		char b[4] = { (char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24) };
+		bytes.append(b, sizeof(b));
+	}
+
+	void write_u64(uint64_t value) {
+		write_u32((uint32_t)value);
+		write_u32((uint32_t)(value >> 32));
+	}
+
+	void write_string(const std::string &str) {
+		write_u32((uint32_t)str.length());
+		bytes += str;
+	}
+
+	void write_bytes(const char *data, size_t length) {
+		bytes.append(data, length);
+	}
+
+	const std::string &contents() const {
+		return bytes;
+	}
+};
+
+/*
+Reads the contents of a cache entry that was written by a CacheWriter. Reading past the end of the entry yields zeros and makes
+the reader fail, so entries that are cut short are detected.
+*/
+class CacheReader {
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool ok = true;
+
+	bool available(size_t length) {
+		if ((size_t)(end - pos) >= length)
+			return true;
+		ok = false;
+		pos = end;
+		return false;
+	}
+
+public:
+	CacheReader() :
+		pos(nullptr),
+		end(nullptr) {}
+
+	CacheReader(const uint8_t *begin, const uint8_t *end) :
+		pos(begin),
+		end(end) {}
+
+	uint8_t read_u8() {
+		return available(1) ? *pos++ : 0;
+	}
+
+	uint32_t read_u32() {
+		if (!available(4))
+			return 0;
+		uint32_t value = pos[0] | pos[1] << 8 | pos[2] << 16 | (uint32_t)pos[3] << 24;
+		pos += 4;
+		return value;
+	}
+
+	uint64_t read_u64() {
+		uint64_t value = read_u32();
+		return value | (uint64_t)read_u32() << 32;
+	}
+
+	std::string read_string() {
+		uint32_t length = read_u32();
+		if (!available(length))
+			return std::string();
+		std::string str((const char *)pos, length);
+		pos += length;
+		return str;
+	}
+
+	/*
+	Returns a pointer to the next length bytes and skips them, or nullptr if there are not enough bytes left.
+	*/
+	const char *read_bytes(size_t length) {
+		if (!available(length))
+			return nullptr;
+		const char *bytes = (const char *)pos;
+		pos += length;
+		return bytes;
+	}
+
+	/*
+	Returns true if all reads so far were within the entry.
+	*/
+	bool good() const {
+		return ok;
+	}
+
+	/*
+	Returns true if the whole entry has been read.
+	*/
+	bool at_end() const {
+		return pos == end;
+	}
+};
+
+/*
+A directory that keeps the results of earlier runs, so they do not have to be computed again. Every entry is a file named after its
+64 bit key, with an extension that tells what kind of result it holds. Entries start with a header containing the cache version and
+the key, which is checked when they are loaded.
+The directory is created when the first entry is stored. Its size is limited to CACHE_MAX_SIZE, by removing the entries that were
+used least recently. The directory can be deleted at any time. Entries can be loaded and stored from multiple threads.
+*/
+class CacheDirectory {
+
+	std::string directory;
+
+	//Whether a warning about an unusable directory has been printed
+	mutable std::atomic<bool> warned;
+
+	std::string entry_path(uint64_t key, const char *extension) const;
+	bool create_directory() const;
+
+public:
+	/*
+	Creates a cache in the given directory. Without a directory, nothing is loaded or stored.
+	*/
+	explicit CacheDirectory(const std::string &directory = "") :
+		directory(directory),
+		warned(false) {}
+
+	bool enabled() const {
+		return !directory.empty();
+	}
+
+	/*
+	Maps the entry with the given key and kind into entry, and returns a reader for the contents after the header. The entry is marked
+	as recently used. Returns false if there is no such entry or it is damaged.
+	*/
+	bool load(uint64_t key, const char *extension, RomImage &entry, CacheReader &contents) const;
+
+	/*
+	Stores an entry, replacing an existing entry with the same key and kind. The entry is written to a temporary file first, so other
+	runs never see a partial entry. Failing to store an entry is not an error, since it only means that the result has to be computed
+	again, but a warning is printed once.
+	*/
+	void store(uint64_t key, const char *extension, const CacheWriter &contents) const;
+
+	/*
+	Removes the entries that were used least recently, until the size of all entries is at most CACHE_MAX_SIZE. Files that are not
+	cache entries are never touched.
+	*/
+	void evict() const;
+};
+
+#endif
\ No newline at end of file
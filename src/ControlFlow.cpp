@@ -0,0 +1,306 @@
+#include "ControlFlow.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+//Role of a byte in the code that has been found
+#define NOT_CODE 0
+#define OPCODE 1
+#define OPERAND 2
+
+//Number of offsets that a thread decodes at once during superset disassembly
+#define SUPERSET_CHUNK_SIZE 4096
+
+bool falls_through(const Instruction *ins) {
+	switch (ins->opcode) {
+	case 0xc3:	//JMP
+	case 0xc9:	//RET
+	case 0xe9:	//PCHL
+		return false;
+	}
+	return true;
+}
+
+unsigned int branch_target(const Instruction *ins, unsigned int operand) {
+	if (ins->instruction_type != BRANCH)
+		return NO_TARGET;
+
+	if (ins->operand_length == 2)
+		return operand;
+	else if ((ins->opcode & 0xc7) == 0xc7)	//RST n
+		return ins->opcode & 0x38;
+	else if (ins->opcode == 0xcb)	//RSTV
+		return 0x40;
+	return NO_TARGET;
+}
+
+/*
+Returns the branch target of the instruction starting at the given byte. All bytes of the instruction have to be available.
+*/
+static unsigned int branch_target(const uint8_t *rom) {
+	const Instruction *ins = &(instructions8085[rom[0]]);
+	return branch_target(ins, ins->operand_length == 2 ? rom[1] | (rom[2] << 8) : 0);
+}
+
+/*
+Finds out which bytes may contain code and collects the entry points. Entry points are the reset vector, the interrupt vectors,
+user-defined code labels and the targets of user-defined ret tables.
+*/
+static std::vector<bool> find_entry_points(const DecoderInput &input, std::vector<unsigned int> &entry_points) {
+	unsigned int length = input.size();
+	const uint8_t *rom = input.rom_begin;
+
+	std::vector<bool> code_allowed(length);
+	for (unsigned int i = 0; i < length; i++) {
+		data_type type = input.info->get_data_type(input.base_address + i);
+		code_allowed[i] = type == CODE_T;
+
+		Label *label = input.info->get_label(input.base_address + i);
+		if (type == RET_T && i + 1 < length && label && label->indirect_label())
+			entry_points.push_back(rom[i] | (rom[i + 1] << 8));
+	}
+
+	//The first address of the input is either the reset vector or the start of a separately loaded bank.
+	entry_points.push_back(input.base_address);
+	for (const InterruptVector &v : interrupt_vectors)
+		entry_points.push_back(v.address);
+	for (unsigned int address : input.info->get_code_labels())
+		entry_points.push_back(address);
+
+	return code_allowed;
+}
+
+/*
+Follows the control flow from the addresses in the worklist and marks the bytes of every instruction that is found in code.
+*/
+static void follow_control_flow(const DecoderInput &input, const std::vector<bool> &code_allowed, std::vector<unsigned int> &worklist, std::vector<uint8_t> &code) {
+	unsigned int length = input.size();
+	const uint8_t *rom = input.rom_begin;
+
+	while (!worklist.empty()) {
+		unsigned int address = worklist.back();
+		worklist.pop_back();
+
+		while (input.contains(address)) {
+			unsigned int i = address - input.base_address;
+			if (code[i] == OPCODE || !code_allowed[i])
+				break;
+
+			const Instruction *ins = &(instructions8085[rom[i]]);
+			unsigned int size = ins->operand_length + 1;
+			code[i] = OPCODE;
+			for (unsigned int j = i + 1; j < i + size && j < length; j++) {
+				if (code[j] == NOT_CODE)
+					code[j] = OPERAND;
+			}
+			if (i + size > length)
+				break;
+
+			unsigned int target = branch_target(rom + i);
+			if (target != NO_TARGET)
+				worklist.push_back(target);
+
+			if (!falls_through(ins))
+				break;
+			address += size;
+		}
+	}
+}
+
+void find_reachable_code(DecoderInput &input) {
+	std::vector<unsigned int> worklist;
+	std::vector<bool> code_allowed = find_entry_points(input, worklist);
+
+	std::vector<uint8_t> code(input.size(), NOT_CODE);
+	follow_control_flow(input, code_allowed, worklist, code);
+
+	input.reachable.assign(code.begin(), code.end());
+}
+
+//-------Superset-----------
+
+/*
+Decodes the instructions at the offsets [begin, end) of the superset. An offset is a candidate for code if all bytes of its instruction
+may contain code, and if neither its branch target nor the next instruction lie in data.
+*/
+static void decode_superset(const DecoderInput &input, const std::vector<bool> &code_allowed, unsigned int begin, unsigned int end,
+							std::vector<uint8_t> &candidate, std::vector<unsigned int> &target)
+{
+	unsigned int length = input.size();
+	const uint8_t *rom = input.rom_begin;
+
+	for (unsigned int i = begin; i < end; i++) {
+		if (!code_allowed[i])
+			continue;
+
+		const Instruction *ins = &(instructions8085[rom[i]]);
+		unsigned int size = ins->operand_length + 1;
+		if (i + size > length)
+			continue;
+
+		bool valid = true;
+		for (unsigned int j = i + 1; j < i + size; j++)
+			valid = valid && code_allowed[j];
+
+		unsigned int address = branch_target(rom + i);
+		if (valid && address != NO_TARGET && input.contains(address)) {
+			target[i] = address - input.base_address;
+			valid = code_allowed[target[i]];
+		}
+
+		if (valid && falls_through(ins) && i + size < length)
+			valid = code_allowed[i + size];
+
+		candidate[i] = valid;
+	}
+}
+
+/*
+Returns the offsets of the instructions that can follow the instruction at offset i in the superset.
+*/
+static unsigned int superset_successors(const DecoderInput &input, const std::vector<unsigned int> &target, unsigned int i, unsigned int successors[2]) {
+	const Instruction *ins = &(instructions8085[input.rom_begin[i]]);
+	unsigned int next = i + ins->operand_length + 1;
+	unsigned int count = 0;
+
+	if (falls_through(ins) && next < input.size())
+		successors[count++] = next;
+	if (target[i] != NO_TARGET)
+		successors[count++] = target[i];
+	return count;
+}
+
+void find_superset_code(DecoderInput &input, unsigned int threads) {
+	unsigned int length = input.size();
+	const uint8_t *rom = input.rom_begin;
+
+	std::vector<unsigned int> worklist;
+	std::vector<bool> code_allowed = find_entry_points(input, worklist);
+
+	//Decode an instruction at every offset. Offsets are independent of each other, so chunks of the input are distributed over the threads.
+	std::vector<uint8_t> candidate(length, false);
+	std::vector<unsigned int> target(length, NO_TARGET);
+	unsigned int num_chunks = (length + SUPERSET_CHUNK_SIZE - 1) / SUPERSET_CHUNK_SIZE;
+
+	std::atomic<unsigned int> next_chunk(0);
+	auto decode_chunks = [&]() {
+		unsigned int c;
+		while ((c = next_chunk++) < num_chunks)
+			decode_superset(input, code_allowed, c * SUPERSET_CHUNK_SIZE, std::min(length, (c + 1) * SUPERSET_CHUNK_SIZE), candidate, target);
+	};
+
+	threads = std::max(1u, std::min(threads, num_chunks));
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threads; t++)
+		workers.push_back(std::thread(decode_chunks));
+	decode_chunks();
+	for (std::thread &w : workers)
+		w.join();
+
+	//Collect the predecessors of every offset
+	unsigned int successors[2];
+	std::vector<unsigned int> predecessor_start(length + 1, 0);
+	for (unsigned int i = 0; i < length; i++) {
+		if (!candidate[i])
+			continue;
+		unsigned int count = superset_successors(input, target, i, successors);
+		for (unsigned int s = 0; s < count; s++)
+			predecessor_start[successors[s] + 1]++;
+	}
+	for (unsigned int i = 0; i < length; i++)
+		predecessor_start[i + 1] += predecessor_start[i];
+
+	std::vector<unsigned int> predecessors(predecessor_start[length]);
+	std::vector<unsigned int> fill(predecessor_start.begin(), predecessor_start.end() - 1);
+	for (unsigned int i = 0; i < length; i++) {
+		if (!candidate[i])
+			continue;
+		unsigned int count = superset_successors(input, target, i, successors);
+		for (unsigned int s = 0; s < count; s++)
+			predecessors[fill[successors[s]]++] = i;
+	}
+
+	//An instruction that leads to an offset which is not a candidate cannot be code either
+	std::vector<unsigned int> rejected;
+	for (unsigned int i = 0; i < length; i++) {
+		if (!candidate[i])
+			rejected.push_back(i);
+	}
+	while (!rejected.empty()) {
+		unsigned int i = rejected.back();
+		rejected.pop_back();
+		for (unsigned int p = predecessor_start[i]; p < predecessor_start[i + 1]; p++) {
+			if (candidate[predecessors[p]]) {
+				candidate[predecessors[p]] = false;
+				rejected.push_back(predecessors[p]);
+			}
+		}
+	}
+
+	//Count how often each candidate is the target of another candidate
+	std::vector<unsigned int> references(length, 0);
+	for (unsigned int i = 0; i < length; i++) {
+		if (candidate[i] && target[i] != NO_TARGET)
+			references[target[i]]++;
+	}
+
+	//Code that is reachable from the entry points is always part of the result
+	std::vector<uint8_t> code(length, NOT_CODE);
+	follow_control_flow(input, code_allowed, worklist, code);
+
+	//Add the remaining branch targets, most referenced first. A target is only added together with all the code that can be reached
+	//from it, and only if none of these instructions overlap with code that has already been chosen.
+	std::vector<unsigned int> order;
+	for (unsigned int i = 0; i < length; i++) {
+		if (candidate[i] && references[i] > 0 && code[i] == NOT_CODE)
+			order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return references[a] > references[b]; });
+
+	//Bytes claimed by the current attempt are marked with 2 * attempt for operands and 2 * attempt + 1 for opcodes
+	std::vector<unsigned int> claimed(length, 0);
+	std::vector<unsigned int> chain;
+	unsigned int attempt = 0;
+	for (unsigned int start : order) {
+		if (code[start] != NOT_CODE)
+			continue;
+
+		attempt++;
+		chain.clear();
+		worklist.assign(1, start);
+		bool consistent = true;
+		while (consistent && !worklist.empty()) {
+			unsigned int i = worklist.back();
+			worklist.pop_back();
+
+			//Joins code that has already been chosen
+			if (code[i] == OPCODE || claimed[i] == 2 * attempt + 1)
+				continue;
+
+			unsigned int size = instructions8085[rom[i]].operand_length + 1;
+			for (unsigned int j = i; j < i + size; j++)
+				consistent = consistent && code[j] == NOT_CODE && claimed[j] < 2 * attempt;
+			if (!consistent)
+				break;
+
+			claimed[i] = 2 * attempt + 1;
+			for (unsigned int j = i + 1; j < i + size; j++)
+				claimed[j] = 2 * attempt;
+			chain.push_back(i);
+
+			unsigned int count = superset_successors(input, target, i, successors);
+			for (unsigned int s = 0; s < count; s++)
+				worklist.push_back(successors[s]);
+		}
+
+		if (!consistent)
+			continue;
+		for (unsigned int i : chain) {
+			code[i] = OPCODE;
+			for (unsigned int j = i + 1; j < i + instructions8085[rom[i]].operand_length + 1; j++)
+				code[j] = OPERAND;
+		}
+	}
+
+	input.reachable.assign(code.begin(), code.end());
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef CONTROL_FLOW_H
+#define CONTROL_FLOW_H
+
+#include "Decoder.h"
+
+//Branch target of instructions that do not jump to a fixed address
+#define NO_TARGET 0xffffffff
+
+/*
+Checks whether execution can continue with the next instruction after the given instruction.
+*/
+bool falls_through(const Instruction *ins);
+
+/*
+Returns the address that the instruction with the given operand jumps to, or NO_TARGET if it is not a branch with a fixed target.
+*/
+unsigned int branch_target(const Instruction *ins, unsigned int operand);
+
+/*
+Follows the control flow from all entry points and marks every byte that belongs to a reachable instruction in input.reachable.
+*/
+void find_reachable_code(DecoderInput &input);
+
+/*
+Superset disassembly: decodes an instruction at every offset of the input, using up to the given number of threads, and then
+chooses a consistent set of non-overlapping instructions. The result starts with the code that is reachable from the entry points
+and is extended by chains of instructions that are the target of a branch and do not run into data or into each other.
+Every byte of the chosen instructions is marked in input.reachable.
+*/
+void find_superset_code(DecoderInput &input, unsigned int threads);
+
+#endif
\ No newline at end of file
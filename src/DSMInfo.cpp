@@ -1,9 +1,11 @@
 #include "DSMInfo.h"
+#include <algorithm>
+#include <set>
 #include <stdexcept>
 #include <iostream>
 
 template<class T>
-static int bisect(std::vector<T> list, unsigned int address, unsigned int (*value_of)(T item)) {
+static int bisect(const std::vector<T> &list, unsigned int address, unsigned int (*value_of)(T item)) {
 	unsigned int start = 0, end = (unsigned int) list.size();
 	unsigned int pivot = (start + end) / 2;
 	while (start < end) {
@@ -59,81 +61,69 @@ void DSMInfo::set_data_type(unsigned int start_address, unsigned int end_address
 		data_types.erase(start_it);
 }
 
-data_type DSMInfo::get_data_type() {
-	data_type type = data_types[data_type_index].second;	//Read data type from labels
-	if (type == UNDEFINED_T) {
-		Segment *s = get_segment();		//Read data type from current segment
-		if (s)
-			return s->type;
-		else
-			return CODE_T;		//Default type
-	}
-	else
-		return type;
+//---------Address table----------
+
+void DSMInfo::clear() {
+	for (Segment *s : segments)
+		delete s;
+	for (Comment *c : comments)
+		delete c;
+	for (Label *l : label_refs)
+		delete l;
+
+	segments.clear();
+	comments.clear();
+	label_refs.clear();
+	labels.clear();
+	label_ranges.clear();
+	address_table.clear();
+	data_types.assign(1, std::pair<unsigned int, data_type>(0, UNDEFINED_T));
 }
 
-//---------Control----------
-
-void DSMInfo::reset(unsigned int base_address) {
-	//Reset indices
-	current_address = base_address;
-	segment_index = 0;
-	data_type_index = 0;
-	comment_index = 0;
+void DSMInfo::compile() {
+	address_table.assign(ADDRESS_SPACE_SIZE, AddressInfo());
 
-	//Setup first instance of next_*_start variables
-
-	if (segments.size() > 1)
-		next_segment_start = segments[1]->start_address;
-	else	//no user-defined segments
-		next_segment_start = (unsigned int)-1;
-
-	if (data_types.size() > 1) {
-		next_data_type_start = data_types[1].first;
-	}
-	else {
-		next_data_type_start = (unsigned int)-1;
+	//Segments
+	for (size_t i = 0; i < segments.size() && segments[i]->start_address < ADDRESS_SPACE_SIZE; i++) {
+		Segment *s = segments[i];
+		for (unsigned int address = s->start_address; address <= s->end_address && address < ADDRESS_SPACE_SIZE; address++) {
+			address_table[address].type = s->type;
+			address_table[address].flags |= ADDRESS_IN_SEGMENT;
+			address_table[address].segment = (uint16_t)i;
+		}
+		address_table[s->start_address].flags |= ADDRESS_SEGMENT_START;
+		if (s->end_address < ADDRESS_SPACE_SIZE)
+			address_table[s->end_address].flags |= ADDRESS_SEGMENT_END;
 	}
 
-	if (comments.size() > 1)
-		next_comment = comments[1]->address;
-	else	//No user-defined comments
-		next_comment = (unsigned int)-1;
-}
-
-void DSMInfo::advance() {
-	current_address++;
-
-	//Check if the next segment has been entered
-	if (current_address >= next_segment_start) {
-		//Increment index
-		segment_index++;
-		if (segment_index + 1 < segments.size()) {	//Set when segment_index should be incremented again
-			next_segment_start = segments[segment_index + 1]->start_address;
-		}
-		else {	//No more segments remaining
-			next_segment_start = (unsigned int) -1;
-		}
+	//Data types of labels take precedence over the data types of segments
+	for (size_t i = 0; i < data_types.size() && data_types[i].first < ADDRESS_SPACE_SIZE; i++) {
+		if (data_types[i].second == UNDEFINED_T)
+			continue;
+		unsigned int end = i + 1 < data_types.size() ? std::min(data_types[i + 1].first, (unsigned int)ADDRESS_SPACE_SIZE) : ADDRESS_SPACE_SIZE;
+		for (unsigned int address = data_types[i].first; address < end; address++)
+			address_table[address].type = data_types[i].second;
 	}
 
-	//Check if the data type changed. Since the last entry in the data type vector extends to the end of the file, do not increment
-	//the index again when the last change has been reached.
-	if (current_address >= next_data_type_start && data_type_index + 1 < data_types.size()) {
-		data_type_index++;
-		if(data_type_index + 1 < data_types.size())
-			next_data_type_start = data_types[data_type_index + 1].first;
+	//Comments
+	for (size_t i = 0; i < comments.size() && comments[i]->address < ADDRESS_SPACE_SIZE; i++) {
+		address_table[comments[i]->address].flags |= ADDRESS_HAS_COMMENT;
+		address_table[comments[i]->address].comment = (uint16_t)i;
 	}
 
-	//Check if the next address has a comment
-	if (current_address >= next_comment) {
-		comment_index++;
-		if (comment_index + 1< comments.size()) {
-			next_comment = comments[comment_index + 1]->address;
-		}
-		else {
-			next_comment = (unsigned int)-1;
+	//Labels
+	for (const LabelRange &r : label_ranges) {
+		if (!r.label->jump_label)
+			continue;
+		for (unsigned int address = r.start_address; address <= r.end_address && address < ADDRESS_SPACE_SIZE; address++) {
+			if (get_label(address) == r.label)
+				address_table[address].flags |= ADDRESS_JUMP_LABEL;
 		}
 	}
+	for (auto &l : labels) {
+		if (l.first < ADDRESS_SPACE_SIZE && l.second->jump_label)
+			address_table[l.first].flags |= ADDRESS_JUMP_LABEL;
+	}
 }
 
 //-------Comments---------
@@ -157,18 +147,6 @@ void DSMInfo::add_comment(std::string text, unsigned int address) {
 	}
 }
 
-bool DSMInfo::has_comment() {
-	return comment_index<comments.size()
-		&& current_address == comments[comment_index]->address;
-}
-
-Comment *DSMInfo::get_comment() {
-	if (has_comment())
-		return comments[comment_index];
-	else
-		return nullptr;
-}
-
 //-------Segments---------
 
 static unsigned int value_of_segment(Segment *item) {
@@ -188,28 +166,6 @@ void DSMInfo::add_segment(std::string name, data_type data_type, unsigned int st
 	segments.insert(segments.begin() + start_index, s);
 }
 
-bool DSMInfo::is_segment_start() {
-	return segment_index < segments.size()
-		&& current_address == segments[segment_index]->start_address;
-}
-
-bool DSMInfo::is_segment_end() {
-	return segment_index < segments.size()
-		&& current_address == segments[segment_index]->end_address;
-}
-
-Segment *DSMInfo::get_segment() {
-	if (segment_index < segments.size()) {	//Still segments remaining
-		Segment *s = segments[segment_index];
-		if (current_address >= s->start_address && current_address <= s->end_address)	//Inside current segment
-			return s;
-		else	//Outside of current segment but not yet inside the next segment
-			return nullptr;
-	}
-	else	//Outside the last segment
-		return nullptr;
-}
-
 //---------Labels-----------
 
 void DSMInfo::add_label(std::string name, unsigned int address, data_type type, bool jump_label) {
@@ -221,46 +177,252 @@ void DSMInfo::add_label(std::string name, unsigned int address, data_type type,
 
 }
 
-void DSMInfo::add_indirect_label(std::string name, unsigned int address, unsigned int offset) {
-	//Only add a jump label for the first element of the ret table, similar to ranged labels
-	IndirectLabel *l = new IndirectLabel(name, address, offset >> 1, offset == 0);
+void DSMInfo::set_label_range(unsigned int start_address, unsigned int end_address, Label *label) {
+	//Find the existing ranges that overlap the new range. Since ranges do not overlap, the end addresses are sorted as well.
+	auto first = std::lower_bound(label_ranges.begin(), label_ranges.end(), start_address,
+		[](const LabelRange &r, unsigned int address) { return r.end_address < address; });
+	auto last = std::upper_bound(first, label_ranges.end(), end_address,
+		[](unsigned int address, const LabelRange &r) { return address < r.start_address; });
+
+	//Keep the parts of the overlapped ranges that lie outside the new range
+	std::vector<LabelRange> pieces;
+	if (first != last && first->start_address < start_address)
+		pieces.push_back(LabelRange(first->start_address, start_address - 1, first->label));
+	pieces.push_back(LabelRange(start_address, end_address, label));
+	if (first != last && (last - 1)->end_address > end_address)
+		pieces.push_back(LabelRange(end_address + 1, (last - 1)->end_address, (last - 1)->label));
+
+	auto it = label_ranges.erase(first, last);
+	label_ranges.insert(it, pieces.begin(), pieces.end());
+}
 
+void DSMInfo::add_range_label(std::string name, unsigned int start_address, unsigned int end_address, data_type type, bool jump_label) {
+	Label *l, *l_head;
+	if (type == RET_T) {
+		//Only add a jump label for the first element of the ret table
+		l = new IndirectLabel(name, start_address, end_address, false);
+		l_head = new IndirectLabel(name, start_address, end_address, true);
+	}
+	else {
+		l = new RangeLabel(name, start_address, end_address, type, jump_label);
+		l_head = new RangeLabel(name, start_address, end_address, type, true);
+	}
 	label_refs.push_back(l);
-	labels[address + offset] = l;
+	label_refs.push_back(l_head);
+
+	//Override all existing labels in the range. Separate label for the first element, since it signifies the start of the range
+	labels.erase(labels.lower_bound(start_address), labels.upper_bound(end_address));
+	labels[start_address] = l_head;
+	if (end_address > start_address)
+		set_label_range(start_address + 1, end_address, l);
+
+	set_data_type(start_address, end_address + 1, type);
 }
 
-void DSMInfo::add_range_label(std::string name, unsigned int start_address, unsigned int end_address, data_type type, bool jump_label) {
-	RangeLabel *rl = new RangeLabel(name, start_address, end_address, type, jump_label);
-	RangeLabel *rl_head = new RangeLabel(name, start_address, end_address, type, true);
-	label_refs.push_back(rl);
-	label_refs.push_back(rl_head);
+bool DSMInfo::label_at(unsigned int address) const {
+	return get_label(address) != nullptr;
+}
 
-	//Separate label for the first element, since it signifies the start of the range
-	labels[start_address] = rl_head;
+Label *DSMInfo::get_label(unsigned int address) const {
+	//Single-address labels are either newer than the range label at the same address, or the first address of a range label
+	auto it = labels.find(address);
+	if (it != labels.end())
+		return it->second;
 
-	if (type == RET_T) {
-		for (unsigned int i = 0; i <= end_address - start_address; i += 2) {
-			add_indirect_label(name, start_address, i);
+	auto r = std::upper_bound(label_ranges.begin(), label_ranges.end(), address,
+		[](unsigned int address, const LabelRange &r) { return address < r.start_address; });
+	if (r == label_ranges.begin() || address > (r - 1)->end_address)
+		return nullptr;
+
+	Label *l = (r - 1)->label;
+	if (l->indirect_label() && (address - l->start_address) % 2 != 0)
+		return nullptr;
+	return l;
+}
+
+std::vector<unsigned int> DSMInfo::get_code_labels() const {
+	std::vector<unsigned int> addresses;
+	for (Label *l : label_refs) {
+		if (l->type == CODE_T && !l->indirect_label())
+			addresses.push_back(l->start_address);
+	}
+	return addresses;
+}
+
+//---------Builder-----------
+
+/*
+A value that covers the addresses from start_address to end_address (inclusive). Layers with a higher level cover layers with a lower level.
+*/
+template<class T>
+struct Layer {
+	unsigned int start_address;
+	unsigned int end_address;
+	unsigned int level;
+	T value;
+
+	Layer(unsigned int start_address, unsigned int end_address, unsigned int level, T value) :
+		start_address(start_address),
+		end_address(end_address),
+		level(level),
+		value(value)
+	{}
+};
+
+/*
+Returns the parts of the given layers that are visible from above, sorted by address. Adjacent parts with the same value are merged.
+*/
+template<class T>
+static std::vector<Layer<T>> flatten(const std::vector<Layer<T>> &layers) {
+	//A layer becomes active at its start address and inactive after its end address. Odd event indices mark the end of a layer.
+	std::vector<std::pair<unsigned long long, size_t>> events;
+	events.reserve(layers.size() * 2);
+	for (size_t i = 0; i < layers.size(); i++) {
+		events.push_back(std::make_pair((unsigned long long)layers[i].start_address, i * 2));
+		events.push_back(std::make_pair((unsigned long long)layers[i].end_address + 1, i * 2 + 1));
+	}
+	std::sort(events.begin(), events.end());
+
+	std::vector<Layer<T>> visible;
+	std::set<std::pair<unsigned int, size_t>> active;
+	size_t e = 0;
+	while (e < events.size()) {
+		unsigned long long address = events[e].first;
+		for (; e < events.size() && events[e].first == address; e++) {
+			size_t i = events[e].second / 2;
+			if (events[e].second % 2 == 0)
+				active.insert(std::make_pair(layers[i].level, i));
+			else
+				active.erase(std::make_pair(layers[i].level, i));
 		}
+
+		//The topmost layer is visible up to the next event. Since every active layer has an end event, there is always a next event.
+		if (active.empty())
+			continue;
+		const T &value = layers[active.rbegin()->second].value;
+		unsigned int end_address = (unsigned int)(events[e].first - 1);
+		if (!visible.empty() && visible.back().end_address + 1 == address && visible.back().value == value)
+			visible.back().end_address = end_address;
+		else
+			visible.push_back(Layer<T>((unsigned int)address, end_address, 0, value));
 	}
-	else {
-		//Add pointer to the new label for every byte in the range.
-		for (unsigned int i = start_address + 1; i <= end_address; i++) {
-			labels[i] = rl;
+	return visible;
+}
+
+void DSMInfoBuilder::build_segments(DSMInfo &info) {
+	std::vector<Segment *> merged;
+	merged.reserve(info.segments.size() + segments.size());
+	merged.insert(merged.end(), info.segments.begin(), info.segments.end());
+	for (Segment &s : segments)
+		merged.push_back(new Segment(s));
+	std::stable_sort(merged.begin(), merged.end(), [](const Segment *a, const Segment *b) { return a->start_address < b->start_address; });
+
+	for (size_t i = 1; i < merged.size(); i++) {
+		if (merged[i - 1]->end_address >= merged[i]->start_address) {
+			//Only delete the new segments, the existing ones still belong to info
+			for (Segment *s : merged) {
+				if (std::find(info.segments.begin(), info.segments.end(), s) == info.segments.end())
+					delete s;
+			}
+			throw std::invalid_argument("Segments can not overlap");
 		}
 	}
-	set_data_type(start_address, end_address + 1, type);
+	info.segments.swap(merged);
 }
 
-bool DSMInfo::label_at(unsigned int address) {
-	return labels.find(address) != labels.end();
+void DSMInfoBuilder::build_comments(DSMInfo &info) {
+	//Sort the new comments and only keep the last comment for every address
+	std::stable_sort(comments.begin(), comments.end(), [](const Comment &a, const Comment &b) { return a.address < b.address; });
+	std::vector<Comment *> merged;
+	merged.reserve(info.comments.size() + comments.size());
+
+	//Merge with the existing comments. New comments overwrite existing comments at the same address.
+	size_t i = 0;
+	for (size_t j = 0; j < comments.size(); j++) {
+		if (j + 1 < comments.size() && comments[j + 1].address == comments[j].address)
+			continue;
+		for (; i < info.comments.size() && info.comments[i]->address <= comments[j].address; i++) {
+			if (info.comments[i]->address == comments[j].address)
+				delete info.comments[i];
+			else
+				merged.push_back(info.comments[i]);
+		}
+		merged.push_back(new Comment(comments[j]));
+	}
+	merged.insert(merged.end(), info.comments.begin() + i, info.comments.end());
+	info.comments.swap(merged);
 }
 
-Label *DSMInfo::get_label(unsigned int address) {
-	if(label_at(address))
-		return labels[address];
-	else
-		return nullptr;
+void DSMInfoBuilder::build_labels(DSMInfo &info) {
+	//Visible labels are stored with a flag that tells whether they belong into label_ranges
+	typedef std::pair<Label *, bool> LabelEntry;
+	std::vector<Layer<LabelEntry>> label_layers;
+	std::vector<Layer<data_type>> type_layers;
+
+	//Existing information is covered by everything new. Existing single-address labels cover existing range labels.
+	for (const LabelRange &r : info.label_ranges)
+		label_layers.push_back(Layer<LabelEntry>(r.start_address, r.end_address, 0, LabelEntry(r.label, true)));
+	for (auto &l : info.labels)
+		label_layers.push_back(Layer<LabelEntry>(l.first, l.first, 1, LabelEntry(l.second, false)));
+	for (size_t i = 0; i < info.data_types.size(); i++) {
+		unsigned int end = i + 1 < info.data_types.size() ? info.data_types[i + 1].first - 1 : (unsigned int)-1;
+		type_layers.push_back(Layer<data_type>(info.data_types[i].first, end, 0, info.data_types[i].second));
+	}
+
+	unsigned int level = 2;
+	for (PendingLabel &p : labels) {
+		Label *l, *l_head;
+		if (!p.range) {
+			l_head = new Label(p.name, p.start_address, p.type, p.jump_label);
+			l = nullptr;
+		}
+		else if (p.type == RET_T) {
+			//Only add a jump label for the first element of the ret table
+			l = new IndirectLabel(p.name, p.start_address, p.end_address, false);
+			l_head = new IndirectLabel(p.name, p.start_address, p.end_address, true);
+		}
+		else {
+			l = new RangeLabel(p.name, p.start_address, p.end_address, p.type, p.jump_label);
+			l_head = new RangeLabel(p.name, p.start_address, p.end_address, p.type, true);
+		}
+
+		info.label_refs.push_back(l_head);
+		label_layers.push_back(Layer<LabelEntry>(p.start_address, p.start_address, level, LabelEntry(l_head, false)));
+		if (l) {
+			info.label_refs.push_back(l);
+			if (p.end_address > p.start_address)
+				label_layers.push_back(Layer<LabelEntry>(p.start_address + 1, p.end_address, level, LabelEntry(l, true)));
+		}
+
+		//set_data_type() ignores ranges that end at the end of the address space
+		if (p.end_address != (unsigned int)-1)
+			type_layers.push_back(Layer<data_type>(p.start_address, p.end_address, level, p.type));
+		level++;
+	}
+
+	info.labels.clear();
+	info.label_ranges.clear();
+	for (const Layer<LabelEntry> &v : flatten(label_layers)) {
+		if (v.value.second)
+			info.label_ranges.push_back(LabelRange(v.start_address, v.end_address, v.value.first));
+		else
+			info.labels.emplace_hint(info.labels.end(), v.start_address, v.value.first);
+	}
+
+	info.data_types.clear();
+	for (const Layer<data_type> &v : flatten(type_layers))
+		info.data_types.push_back(std::pair<unsigned int, data_type>(v.start_address, v.value));
+}
+
+void DSMInfoBuilder::build(DSMInfo &info) {
+	//Segments are built first, since they are the only part that can fail
+	build_segments(info);
+	build_comments(info);
+	build_labels(info);
+
+	segments.clear();
+	labels.clear();
+	comments.clear();
 }
 
 void DSMInfo::test() {
@@ -1,9 +1,10 @@
 #ifndef DSMINFO_H
 #define DSMINFO_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
-#include <unordered_map>
+#include <map>
 
 enum data_type {
 	UNDEFINED_T, CODE_T, BYTES_T, DWORDS_BE_T, DWORDS_LE_T, TEXT_T, RET_T
@@ -113,12 +114,15 @@ struct RangeLabel : public Label {
 	}
 };
 
+/*
+Represents a ret table. Every entry of the table is a two byte pointer to a jump target, so the label only applies to the first byte of each entry.
+*/
 struct IndirectLabel : public Label {
-	unsigned int offset;
+	unsigned int end_address;
 
-	IndirectLabel(std::string name, unsigned int address, unsigned int offset, bool jump_label) :
-		Label(name, address, CODE_T, jump_label),
-		offset(offset)
+	IndirectLabel(std::string name, unsigned int start_address, unsigned int end_address, bool jump_label) :
+		Label(name, start_address, CODE_T, jump_label),
+		end_address(end_address)
 	{}
 
 	virtual std::string get_jump_target_name(unsigned int address) {
@@ -131,8 +135,11 @@ struct IndirectLabel : public Label {
 		return "";
 	}
 
-	int get_offset() {
-		return offset;
+	/*
+	Returns the index of the table entry at the given address.
+	*/
+	int get_offset(unsigned int address) {
+		return (address - start_address) >> 1;
 	}
 
 	/*
@@ -143,6 +150,21 @@ struct IndirectLabel : public Label {
 	}
 };
 
+/*
+The addresses from start_address to end_address (inclusive) that are covered by a range label.
+*/
+struct LabelRange {
+	unsigned int start_address;
+	unsigned int end_address;
+	Label *label;
+
+	LabelRange(unsigned int start_address, unsigned int end_address, Label *label) :
+		start_address(start_address),
+		end_address(end_address),
+		label(label)
+	{}
+};
+
 /*
 A comment in the disassembly. A comment is basically text that is a associated with a single address.
 */
@@ -156,37 +178,70 @@ struct Comment {
 	{}
 };
 
+//Flags of AddressInfo
+#define ADDRESS_IN_SEGMENT 0x01
+#define ADDRESS_SEGMENT_START 0x02
+#define ADDRESS_SEGMENT_END 0x04
+#define ADDRESS_HAS_COMMENT 0x08
+#define ADDRESS_JUMP_LABEL 0x10
+
+//Number of addresses that are covered by the address table of a DSMInfo
+#define ADDRESS_SPACE_SIZE 0x10000
+
+/*
+All information of a DSMInfo instance about a single address, so that it can be queried with a single lookup.
+*/
+struct AddressInfo {
+	uint8_t type = CODE_T;	//Effective data_type
+	uint8_t flags = 0;
+	uint16_t segment = 0;	//Index into DSMInfo::segments, if ADDRESS_IN_SEGMENT is set
+	uint16_t comment = 0;	//Index into DSMInfo::comments, if ADDRESS_HAS_COMMENT is set
+};
+
 /*
 DSMInfo instances contain various information that should get added to a disassembly. This includes segment boundaries, labels, comments etc.
-Once a DSMInfo instance is populated with these information, the data can be accessed in a stream-like manner. The disassembler will call
-advance() once for every address, which will cause the DSMInfo instance to load the data for the next address. Only the information for the current
-address can be read at any time.
+Once a DSMInfo instance is populated with these information, compile() turns them into a table with one entry per address, so that
+the information for any address can be looked up directly. Since the table is never modified by the lookups, it can be read from
+multiple threads at the same time.
 */
 class DSMInfo {
 
-	//Indices
-	unsigned int current_address = 0;
-	unsigned int segment_index = 0;
-	unsigned int next_segment_start = 0;
-	unsigned int data_type_index = 0;
-	unsigned int next_data_type_start = 0;
-	unsigned int comment_index = 0;
-	unsigned int next_comment = 0;
+	friend class DSMInfoBuilder;
 
 	//Main data structures
 	std::vector<Segment *> segments;
 	std::vector<std::pair<unsigned int, data_type>> data_types;
-	std::unordered_map<unsigned int, Label *> labels;
+	std::map<unsigned int, Label *> labels;	//Single-address labels and the first address of range labels
+	std::vector<LabelRange> label_ranges;	//Remaining addresses of range labels. Sorted, ranges do not overlap.
 	std::vector<Comment *> comments;
 
 	//vector of all labels in the order they were added. Used for memory management.
 	std::vector<Label *> label_refs;
 
+	//Table with the information for every address. Empty until compile() is called.
+	std::vector<AddressInfo> address_table;
+
 	/*
 	Helper to manage the data_types vector.
 	*/
 	void set_data_type(unsigned int start_address, unsigned int end_address, data_type data_type);
 
+	/*
+	Helper to manage the label_ranges vector. Parts of existing ranges that overlap the new range are removed.
+	*/
+	void set_label_range(unsigned int start_address, unsigned int end_address, Label *label);
+
+	/*
+	Returns the table entry for the given address. Addresses that are not covered by the table get the default entry.
+	*/
+	const AddressInfo &address_info(unsigned int address) const {
+		static const AddressInfo default_info;
+		if (address < address_table.size())
+			return address_table[address];
+		else
+			return default_info;
+	}
+
 public:
 	DSMInfo() {
 		//Initialize data types with all undefined
@@ -194,30 +249,27 @@ public:
 	}
 
 	~DSMInfo() {
-		for (Segment *s : segments)
-			delete s;
-		for (Comment *c : comments)
-			delete c;
-		for (Label *l : label_refs)
-			delete l;
+		clear();
 	}
 
 	/*
-	Returns the data type at the current address. This first checks if any single-address or ranged labels specify a data type.
-	If not this function returns the data_type of the current segment. If the current address does not lie in a segments,
-	this function returns CODE_T.
+	Removes all segments, data types, labels and comments, as well as the address table.
 	*/
-	data_type get_data_type();
+	void clear();
 
 	/*
-	Resets the DSMInfo stream and initialized it with the given base_address.
+	Builds the address table from the segments, data types, labels and comments. Has to be called before any of the
+	address queries below. Changes that are made afterwards only become visible after compile() is called again.
 	*/
-	void reset(unsigned int base_address);
+	void compile();
 
 	/*
-	Advances the DSMInfo stream to the next address.
+	Returns the data type at the given address. Data types of labels take precedence over the data type of the segment
+	containing the address. Addresses outside of segments default to CODE_T.
 	*/
-	void advance();
+	data_type get_data_type(unsigned int address) const {
+		return (data_type)address_info(address).type;
+	}
 
 	/*
 	Adds a segment to this DSMInfo. If it overlaps with already existing segments, an exception is thrown.
@@ -225,19 +277,33 @@ public:
 	void add_segment(std::string name, data_type data_type, unsigned int start_address, unsigned int end_address);
 
 	/*
-	Checks whether a segment starts at the current address.
+	Checks whether a segment starts at the given address.
 	*/
-	bool is_segment_start();
+	bool is_segment_start(unsigned int address) const {
+		return (address_info(address).flags & ADDRESS_SEGMENT_START) != 0;
+	}
 
 	/*
-	Checks whether a segment ends at the current address.
+	Checks whether a segment ends at the given address.
 	*/
-	bool is_segment_end();
+	bool is_segment_end(unsigned int address) const {
+		return (address_info(address).flags & ADDRESS_SEGMENT_END) != 0;
+	}
 
 	/*
-	Returns a pointer to the segment that contains the current address. Returns nullptr if the current address does not lie in a user-defined segment.
+	Returns a pointer to the segment that contains the given address. Returns nullptr if the address does not lie in a user-defined segment.
 	*/
-	Segment *get_segment();
+	Segment *get_segment(unsigned int address) const {
+		const AddressInfo &ai = address_info(address);
+		return (ai.flags & ADDRESS_IN_SEGMENT) ? segments[ai.segment] : nullptr;
+	}
+
+	/*
+	Returns all segments, sorted by address.
+	*/
+	const std::vector<Segment *> &get_segments() const {
+		return segments;
+	}
 
 	/*
 	Adds a new comment to this DSMInfo. If a comment already exists at the given address, it will get overwritten.
@@ -245,24 +311,31 @@ public:
 	void add_comment(std::string text, unsigned int address);
 
 	/*
-	Checks wether there is a comment at the current address.
+	Checks wether there is a comment at the given address.
 	*/
-	bool has_comment();
+	bool has_comment(unsigned int address) const {
+		return (address_info(address).flags & ADDRESS_HAS_COMMENT) != 0;
+	}
 
 	/*
-	Returns a pointer to the comment at the current address, or nullptr if there is none.
+	Returns a pointer to the comment at the given address, or nullptr if there is none.
 	*/
-	Comment *get_comment();
-	
+	Comment *get_comment(unsigned int address) const {
+		const AddressInfo &ai = address_info(address);
+		return (ai.flags & ADDRESS_HAS_COMMENT) ? comments[ai.comment] : nullptr;
+	}
+
 	/*
-	Adds a new single-address label to this DSMInfo. If a label already exists at the given address, it will get overwritten.
+	Checks whether there is a label at the given address that appears as a jump target.
 	*/
-	void add_label(std::string name, unsigned int address, data_type type, bool jump_label = true);
+	bool jump_label_at(unsigned int address) const {
+		return (address_info(address).flags & ADDRESS_JUMP_LABEL) != 0;
+	}
 
 	/*
-	Adds an indirect label where the pointer is stored at the given address in the file. 
+	Adds a new single-address label to this DSMInfo. If a label already exists at the given address, it will get overwritten.
 	*/
-	void add_indirect_label(std::string name, unsigned int address, unsigned int offset);
+	void add_label(std::string name, unsigned int address, data_type type, bool jump_label = true);
 
 	/*
 	Adds a new range label to this DSMInfo. This will override all existing labels inside the given range.
@@ -272,16 +345,90 @@ public:
 	/*
 	Checks whether there is a label at the given address
 	*/
-	bool label_at(unsigned int address);
+	bool label_at(unsigned int address) const;
 
 	/*
 	Returns the label at the given address or nullptr if there is none
 	*/
-	Label *get_label(unsigned int address);
+	Label *get_label(unsigned int address) const;
+
+	/*
+	Returns the start addresses of all labels that have the code data type.
+	*/
+	std::vector<unsigned int> get_code_labels() const;
 
 	//Test
 	void test();
 	void print_data_types();
 };
 
+/*
+Collects segments, labels and comments and adds them to a DSMInfo all at once. Adding entries to a DSMInfo directly keeps its
+vectors sorted after every single entry, which gets slow for large label files. The builder sorts all entries once instead.
+The result is the same as if the entries had been added to the DSMInfo directly, in the same order.
+*/
+class DSMInfoBuilder {
+
+	struct PendingLabel {
+		std::string name;
+		unsigned int start_address;
+		unsigned int end_address;
+		data_type type;
+		bool jump_label;
+		bool range;
+
+		PendingLabel(std::string name, unsigned int start_address, unsigned int end_address, data_type type, bool jump_label, bool range) :
+			name(name),
+			start_address(start_address),
+			end_address(end_address),
+			type(type),
+			jump_label(jump_label),
+			range(range)
+		{}
+	};
+
+	std::vector<Segment> segments;
+	std::vector<PendingLabel> labels;
+	std::vector<Comment> comments;
+
+	void build_segments(DSMInfo &info);
+	void build_comments(DSMInfo &info);
+	void build_labels(DSMInfo &info);
+
+public:
+	/*
+	Adds a segment. Overlapping segments are reported by build().
+	*/
+	void add_segment(std::string name, data_type data_type, unsigned int start_address, unsigned int end_address) {
+		segments.push_back(Segment(name, data_type, start_address, end_address));
+	}
+
+	/*
+	Adds a comment. Comments that are added later overwrite earlier comments at the same address.
+	*/
+	void add_comment(std::string text, unsigned int address) {
+		comments.push_back(Comment(text, address));
+	}
+
+	/*
+	Adds a single-address label. Labels that are added later override earlier labels at the same address.
+	*/
+	void add_label(std::string name, unsigned int address, data_type type, bool jump_label = true) {
+		labels.push_back(PendingLabel(name, address, address, type, jump_label, false));
+	}
+
+	/*
+	Adds a range label. Labels that are added later override earlier labels inside the range.
+	*/
+	void add_range_label(std::string name, unsigned int start_address, unsigned int end_address, data_type type, bool jump_label = false) {
+		labels.push_back(PendingLabel(name, start_address, end_address, type, jump_label, true));
+	}
+
+	/*
+	Adds all collected entries to the given DSMInfo and clears the builder. Throws std::invalid_argument if the segments overlap,
+	in which case the DSMInfo is not modified.
+	*/
+	void build(DSMInfo &info);
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "DecodeCache.h"
+#include <vector>
+
+//Extension of the entries in the CacheDirectory
+#define DECODE_EXTENSION ".dsmd"
+
+void DecodeCache::compute_key(const DecoderInput &input, unsigned int mode) {
+	const DSMInfo &info = *input.info;
+	Hash hash;
+	hash.add(mode);
+	hash.add(input.base_address);
+	hash.add(input.size());
+	hash.add(input.rom_begin, input.size());
+
+	//Everything that the Decoder and the control flow analysis look up for the addresses of the input
+	std::vector<uint8_t> properties(input.size());
+	for (unsigned int i = 0; i < input.size(); i++) {
+		unsigned int address = input.base_address + i;
+		properties[i] = (uint8_t)(info.get_data_type(address)
+			| info.is_segment_start(address) << 3
+			| info.is_segment_end(address) << 4
+			| info.has_comment(address) << 5
+			| info.jump_label_at(address) << 6);
+
+		//Ret table entries depend on the position of the table
+		if (info.get_data_type(address) == RET_T) {
+			Label *label = info.get_label(address);
+			hash.add(label && label->indirect_label() ? label->start_address : ADDRESS_SPACE_SIZE);
+		}
+	}
+	hash.add(properties.data(), properties.size());
+
+	//Entry points of the control flow analysis
+	if (mode != DECODE_ALL) {
+		for (unsigned int address : info.get_code_labels())
+			hash.add(address);
+	}
+
+	key = hash.value();
+}
+
+bool DecodeCache::load(JumpLabels &jump_labels, AssemblyLines &lines) const {
+	RomImage entry;
+	CacheReader in;
+	if (!cache.load(key, DECODE_EXTENSION, entry, in))
+		return false;
+
+	uint32_t num_lines = in.read_u32();
+	if (num_lines > ADDRESS_SPACE_SIZE)
+		return false;
+	lines.clear();
+	lines.reserve(num_lines);
+	for (uint32_t i = 0; i < num_lines; i++) {
+		uint32_t address = in.read_u32();
+		uint32_t opcode = in.read_u32();
+		uint32_t operand = in.read_u32();
+		if (opcode >= DATA_RET + 1)
+			return false;
+		lines.push_back(AssemblyLine(address, &(instructions8085[opcode]), operand));
+	}
+
+	jump_labels = JumpLabels();
+	uint32_t num_labels = in.read_u32();
+	for (uint32_t i = 0; i < num_labels && in.good(); i++)
+		jump_labels.labels[in.read_u32() & 0xffff] = true;
+
+	uint32_t num_ret_labels = in.read_u32();
+	for (uint32_t i = 0; i < num_ret_labels && in.good(); i++) {
+		uint32_t address = in.read_u32();
+		uint32_t entry_address = in.read_u32();
+		jump_labels.ret_labels[address] = JumpLabels::RetTableEntry(entry_address & 0xffff, (entry_address >> 16) != 0);
+	}
+
+	return in.good() && in.at_end();
+}
+
+void DecodeCache::store(const JumpLabels &jump_labels, const AssemblyLines &lines) const {
+	CacheWriter out;
+	out.write_u32((uint32_t)lines.size());
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		out.write_u32(line.address);
+		out.write_u32((uint32_t)(line.instruction - instructions8085));
+		out.write_u32((uint32_t)line.operand);
+	}
+
+	std::vector<uint32_t> labels;
+	for (unsigned int address = 0; address < ADDRESS_SPACE_SIZE; address++) {
+		if (jump_labels.labels[address])
+			labels.push_back(address);
+	}
+	out.write_u32((uint32_t)labels.size());
+	for (uint32_t address : labels)
+		out.write_u32(address);
+
+	out.write_u32((uint32_t)jump_labels.ret_labels.size());
+	for (auto &entry : jump_labels.ret_labels) {
+		out.write_u32(entry.first);
+		out.write_u32(entry.second.address | (entry.second.table_start ? 0x10000 : 0));
+	}
+
+	cache.store(key, DECODE_EXTENSION, out);
+}
\ No newline at end of file
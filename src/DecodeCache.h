@@ -0,0 +1,53 @@
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "CacheDirectory.h"
+#include "Decoder.h"
+
+//Ways in which the code in the input is found, which lead to different decoding results
+#define DECODE_ALL 0
+#define DECODE_REACHABLE 1
+#define DECODE_SUPERSET 2
+
+/*
+Keeps the result of decoding in a CacheDirectory, so it does not have to be computed again if neither the input nor the parts of
+the DSMInfo that decoding depends on have changed. The key of a cache entry is a hash over the bytes of the input, its base address
+and the data type, segment boundaries, comments and jump labels at every address of the input. Label names and comment texts do not
+influence decoding, so renaming a label or editing a comment still finds the entry.
+*/
+class DecodeCache {
+
+	const CacheDirectory &cache;
+	uint64_t key = 0;
+
+public:
+	explicit DecodeCache(const CacheDirectory &cache) :
+		cache(cache) {}
+
+	/*
+	Computes the key for decoding the given input. The DSMInfo of the input has to be compiled.
+	*/
+	void compute_key(const DecoderInput &input, unsigned int mode);
+
+	/*
+	Returns the key computed by compute_key().
+	*/
+	uint64_t get_key() const {
+		return key;
+	}
+
+	/*
+	Loads the decoding result for the current key. Returns false if there is no entry or it could not be read.
+	*/
+	bool load(JumpLabels &jump_labels, AssemblyLines &lines) const;
+
+	/*
+	Stores the decoding result under the current key.
+	*/
+	void store(const JumpLabels &jump_labels, const AssemblyLines &lines) const;
+};
+
+#endif
\ No newline at end of file
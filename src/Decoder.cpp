@@ -0,0 +1,405 @@
+#include "Decoder.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "util.h"
+
+//--------Jump labels---------
+
+void JumpLabels::add(unsigned int address) {
+	if (!contains(address)) {
+		labels[address] = true;
+		new_labels.push_back(address);
+	}
+}
+
+void JumpLabels::add_ret_label(unsigned int address, unsigned int entry_address, bool table_start) {
+	add(address);
+	ret_labels[address] = RetTableEntry(entry_address, table_start);
+}
+
+std::string JumpLabels::get_name(unsigned int address, const DSMInfo &info) const {
+	auto it = ret_labels.find(address);
+	if (it == ret_labels.end())
+		return "j" + hex16bit(address);
+
+	const RetTableEntry &entry = it->second;
+	IndirectLabel *il = (IndirectLabel *) info.get_label(entry.address);
+	if (entry.table_start)
+		return il->get_jump_target_name(entry.address);
+	else
+		return il->get_jump_target_name(entry.address) + "[" + std::to_string(il->get_offset(entry.address)) + "]";
+}
+
+void JumpLabels::merge(const JumpLabels &other) {
+	for (unsigned int address : other.new_labels) {
+		auto it = other.ret_labels.find(address);
+		if (it != other.ret_labels.end())
+			add_ret_label(address, it->second.address, it->second.table_start);
+		else
+			add(address);
+	}
+}
+
+//---------Decoding-----------
+
+/*
+Checks if there is a label pointing to the given address. Both user-defined and automatically created labels have to be checked.
+*/
+bool Decoder::jump_label_at(unsigned int address) const {
+	return info.jump_label_at(address) || jump_labels.contains(address);
+}
+
+/*
+Creates a new label to the target address if the given AssemblyLine is BRANCH type instruction.
+*/
+void Decoder::create_label_if_needed(const AssemblyLine &line) {
+	if (line.instruction->instruction_type == BRANCH && line.instruction->operand_length > 0)
+		jump_labels.add(line.operand);
+}
+
+/*
+Checks whether the byte at a given address can be read in as an operand. A byte cannot be an operand if
+1) it is outside the range that should be read (as specified by start_address and end_address, clamped to the input file)
+2) there is a jump label pointing to that address, which means that a new instruction has to start there.
+3) a new segment starts at that address
+4) the instruction has a comment
+5) the control flow is followed and the byte is not part of reachable code
+*/
+bool Decoder::can_read_as_operand(unsigned int address) const {
+	if (!input.contains(address))
+		return false;
+	if (jump_label_at(address))
+		return false;
+	if (info.is_segment_start(address))
+		return false;
+	if (info.has_comment(address))
+		return false;
+	if (!input.reachable.empty() && !input.reachable[address - input.base_address])
+		return false;
+	return true;
+}
+
+/*
+Adds a pseudo-instruction.
+*/
+void Decoder::add_data_instruction(AssemblyLines &lines, int instruction, int address, int data) {
+	AssemblyLine pseudo(address, &(instructions8085[instruction]), data);
+	lines.push_back(std::move(pseudo));
+}
+
+/*
+Fetches a single byte from the input image and increments the address counter.
+*/
+inline int Decoder::fetch_byte() {
+	current_address++;
+	return *rom_pos++;
+}
+
+/*
+Reads a single instruction from the input image and appends it to lines. The instruction may be multiple bytes long, depending on the opcode.
+Advances the current_address counter accordingly.
+*/
+void Decoder::read_code_instruction(AssemblyLines &lines) {
+	int address = current_address;
+	bool segment_end = info.is_segment_end(current_address);
+
+	int opcode = fetch_byte();
+	const Instruction *ins = &(instructions8085[opcode]);
+	int operand = 0;
+
+	if (ins->operand_length == 1) {
+		if (!can_read_as_operand(current_address) || segment_end) {
+			//Output incomplete instruction (data byte) if the next byte could not be read as an operand
+			add_data_instruction(lines, DATA_BYTE, address, opcode);
+			return;
+		}
+		else {
+			operand = fetch_byte();
+		}
+	}
+	else if (ins->operand_length == 2) {
+		//Read first operand byte
+		if (!can_read_as_operand(current_address) || segment_end) {
+			//Output incomplete instruction
+			add_data_instruction(lines, DATA_BYTE, address, opcode);
+			return;
+		}
+		else {
+			//Check if segment ends on the first of the two operand bytes
+			segment_end = info.is_segment_end(current_address);
+
+			//first (least significant) byte of a two byte operand
+			operand = fetch_byte();
+		}
+
+		//Read second operand byte
+		if (!can_read_as_operand(current_address) || segment_end) {
+			//Output two incomplete instructions
+			add_data_instruction(lines, DATA_BYTE, address, opcode);
+			add_data_instruction(lines, DATA_BYTE, address + 1, operand);
+			input.continuation[address + 1 - input.base_address] = true;
+			return;
+		}
+		else {
+			//second (most significant) byte of a two byte operand
+			operand |= fetch_byte() << 8;
+		}
+	}
+
+	//Create AssemblyLine and add label
+	AssemblyLine line(address, ins, operand);
+	create_label_if_needed(line);
+
+	lines.push_back(std::move(line));
+}
+
+void Decoder::seek(unsigned int address) {
+	current_address = address;
+	rom_pos = input.rom_begin + (address - input.base_address);
+}
+
+void Decoder::decode_next(AssemblyLines &lines) {
+	int address = current_address;
+	int data = 0;
+
+	input.continuation[address - input.base_address] = false;
+
+	//Code that can not be reached is output as data
+	data_type type = info.get_data_type(address);
+	if (type == CODE_T && !input.reachable.empty() && !input.reachable[address - input.base_address])
+		type = BYTES_T;
+
+	switch (type) {
+	case CODE_T:
+		read_code_instruction(lines);
+		break;
+	case BYTES_T:
+		data = fetch_byte();
+		add_data_instruction(lines, DATA_BYTE, address, data);
+		break;
+	case DWORDS_BE_T:
+		data = fetch_byte();
+		if (info.get_data_type(current_address) == DWORDS_BE_T && !at_end()) {
+			data = (data << 8) | (fetch_byte() & 0xff);
+			add_data_instruction(lines, DATA_WORD, address, data);
+		}
+		else {
+			add_data_instruction(lines, DATA_BYTE, address, data);
+		}
+		break;
+	case DWORDS_LE_T:
+		data = fetch_byte();
+		if (info.get_data_type(current_address) == DWORDS_LE_T && !at_end()) {
+			data = (fetch_byte() << 8) | (data & 0xff);
+			add_data_instruction(lines, DATA_WORD, address, data);
+		}
+		else {
+			add_data_instruction(lines, DATA_BYTE, address, data);
+		}
+		break;
+	case TEXT_T:
+		data = fetch_byte();
+		add_data_instruction(lines, DATA_TEXT, address, data);
+		break;
+	case RET_T:
+		data = fetch_byte();
+		if (info.get_data_type(current_address) == RET_T && !at_end()) {
+			data = (fetch_byte() << 8) | (data & 0xff);
+			add_data_instruction(lines, DATA_RET, address, data);
+
+			//Entries that do not start on a table entry, because the table was cut by other labels, do not create jump labels
+			Label *label = input.info->get_label(address);
+			if (label && label->indirect_label()) {
+				jump_labels.add_ret_label(data, address, false);
+				jump_labels.add_ret_label(label->start_address, address, true);
+			}
+		}
+		else {
+			add_data_instruction(lines, DATA_BYTE, address, data);
+		}
+		break;
+	default:
+		//Should never happen
+		std::cerr << "Error: info.get_data_type() returned undefined type (UNDEFINED_T)" << std::endl;
+	}
+}
+
+//------Whole input---------
+
+/*
+Labels that get created during decoding can point into instructions that have already been decoded. Such instructions
+have to be split, so this function re-decodes the instructions that contain a new label, up to the point where the
+instruction boundaries line up with the previous result again. Since re-decoding can create further labels, this is
+repeated until no new labels appear.
+*/
+static void fix_up_labels(DecoderInput &input, JumpLabels &jump_labels, AssemblyLines &lines) {
+	Decoder decoder(input, jump_labels);
+
+	//Every byte produces at most one AssemblyLine
+	AssemblyLines fixed;
+	fixed.reserve(input.size());
+
+	while (!jump_labels.new_labels.empty()) {
+		std::vector<unsigned int> targets;
+		targets.swap(jump_labels.new_labels);
+		std::sort(targets.begin(), targets.end());
+
+		fixed.clear();
+
+		size_t i = 0;
+		for (unsigned int target : targets) {
+			//Keep all instructions that end before the label
+			while (i < lines.size() && lines[i].address + lines[i].length() <= target)
+				fixed.push_back(lines[i++]);
+
+			//Nothing to do if the label is outside the input or inside an already re-decoded region
+			if (i == lines.size() || lines[i].address > target)
+				continue;
+
+			unsigned int start = lines[i].address;
+			if (start == target) {
+				//Nothing to do if the label is on an instruction boundary
+				if (!input.is_continuation(target))
+					continue;
+
+				//The label points to the second byte of an incomplete instruction, so that instruction has to be decoded again
+				start = fixed.back().address;
+				fixed.pop_back();
+			}
+
+			//Re-decode until the next instruction would start where a previous instruction started
+			decoder.seek(start);
+			while (true) {
+				decoder.decode_next(fixed);
+				unsigned int address = decoder.get_address();
+				while (i < lines.size() && lines[i].address < address)
+					i++;
+				if (decoder.at_end()
+					|| (i < lines.size() && lines[i].address == address && !input.is_continuation(address)))
+					break;
+			}
+		}
+
+		//Keep remaining instructions
+		while (i < lines.size())
+			fixed.push_back(lines[i++]);
+
+		lines.swap(fixed);
+	}
+}
+
+/*
+Splits the input into ranges that can be decoded independently. Every segment, and every gap between segments, is one range.
+*/
+static std::vector<unsigned int> split_input(const DecoderInput &input) {
+	std::vector<unsigned int> boundaries;
+	unsigned int end = input.base_address + input.size();
+
+	boundaries.push_back(input.base_address);
+	for (Segment *s : input.info->get_segments()) {
+		if (s->start_address > boundaries.back() && s->start_address < end)
+			boundaries.push_back(s->start_address);
+		if (s->end_address + 1 > boundaries.back() && s->end_address + 1 < end)
+			boundaries.push_back(s->end_address + 1);
+	}
+	boundaries.push_back(end);
+	return boundaries;
+}
+
+/*
+Checks whether any of the given jump labels points inside one of the lines of a range, or to the second byte of an incomplete
+instruction. Decoding the range with these labels would have produced different lines.
+*/
+static bool splits_range(const DecoderInput &input, const JumpLabels &jump_labels, const AssemblyLines &lines) {
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		if (input.is_continuation(line.address) && jump_labels.contains(line.address))
+			return true;
+		for (unsigned int address = line.address + 1; address < line.address + line.length(); address++) {
+			if (jump_labels.contains(address))
+				return true;
+		}
+	}
+	return false;
+}
+
+void decode_input(DecoderInput &input, JumpLabels &jump_labels, AssemblyLines &lines, unsigned int threads) {
+	input.continuation.assign(input.size(), 0);
+
+	std::vector<unsigned int> boundaries = split_input(input);
+	size_t num_ranges = boundaries.size() - 1;
+
+	std::vector<JumpLabels> range_labels(num_ranges);
+	std::vector<AssemblyLines> range_lines(num_ranges);
+
+	//Each range is decoded with its own JumpLabels. Labels that point into following ranges are checked when the results are merged,
+	//labels that point into preceding ranges are handled by fix_up_labels().
+	std::atomic<size_t> next_range(0);
+	auto decode_ranges = [&]() {
+		size_t r;
+		while ((r = next_range++) < num_ranges) {
+			Decoder decoder(input, range_labels[r]);
+			range_lines[r].reserve(boundaries[r + 1] - boundaries[r]);
+			decoder.seek(boundaries[r]);
+			while (decoder.get_address() < boundaries[r + 1])
+				decoder.decode_next(range_lines[r]);
+		}
+	};
+
+	threads = std::max(1u, std::min(threads, (unsigned int)num_ranges));
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threads; t++)
+		workers.push_back(std::thread(decode_ranges));
+	decode_ranges();
+	for (std::thread &w : workers)
+		w.join();
+
+	//Merge results in address order. Data words at the end of a range can extend into the next range. A range that does not
+	//start where the preceding range ended, or that would have been split differently with the labels of the preceding ranges,
+	//is decoded again. This way the result is the same as if the whole input had been decoded in a single pass.
+	lines.clear();
+	lines.reserve(input.size());
+	jump_labels = JumpLabels();
+	unsigned int next_address = input.base_address;
+	for (size_t r = 0; r < num_ranges; r++) {
+		if (next_address != boundaries[r] || splits_range(input, jump_labels, range_lines[r])) {
+			std::fill(input.continuation.begin() + (boundaries[r] - input.base_address), input.continuation.begin() + (boundaries[r + 1] - input.base_address), 0);
+			range_lines[r].clear();
+			Decoder decoder(input, jump_labels);
+			decoder.seek(next_address);
+			while (decoder.get_address() < boundaries[r + 1])
+				decoder.decode_next(range_lines[r]);
+		}
+		else
+			jump_labels.merge(range_labels[r]);
+
+		lines.append(range_lines[r]);
+		if (!range_lines[r].empty())
+			next_address = range_lines[r].back().address + range_lines[r].back().length();
+	}
+
+	fix_up_labels(input, jump_labels, lines);
+}
+
+/*
+A label can become unused when the instruction that created it was split during fix_up_labels(). Since such a label still influenced
+how the instructions were decoded, it stays in jump_labels for the purpose of jump_label_at(), but it should not be written to the listing.
+*/
+std::unordered_map<unsigned int, std::string> used_jump_labels(const DecoderInput &input, const JumpLabels &jump_labels, const AssemblyLines &lines) {
+	std::unordered_map<unsigned int, std::string> used_labels;
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		if (line.instruction->opcode == DATA_RET) {
+			Label *label = input.info->get_label(line.address);
+			if (label && label->indirect_label()) {
+				used_labels[line.operand] = jump_labels.get_name(line.operand, *input.info);
+				used_labels[label->start_address] = jump_labels.get_name(label->start_address, *input.info);
+			}
+		}
+		else if (line.instruction->instruction_type == BRANCH && line.instruction->operand_length > 0)
+			used_labels[line.operand] = jump_labels.get_name(line.operand, *input.info);
+	}
+	return used_labels;
+}
@@ -0,0 +1,260 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Instructions.h"
+#include "DSMInfo.h"
+
+/*
+A single Assembly line, consisting of an address, an instruction and an operand.
+*/
+struct AssemblyLine {
+	const unsigned int address;
+	const Instruction *instruction;
+	const int operand;
+
+	AssemblyLine(const unsigned int address, const Instruction *instruction, const int operand) :
+		address(address), instruction(instruction), operand(operand) {}
+
+	/*
+	Returns the number of bytes covered by this AssemblyLine.
+	*/
+	unsigned int length() const {
+		//Pseudo-instructions have no opcode byte
+		if (instruction->instruction_type == DATA)
+			return instruction->operand_length;
+		else
+			return instruction->operand_length + 1;
+	}
+};
+
+/*
+Storage for a sequence of AssemblyLines. Addresses, operands and instruction table indices all fit into 16 bits, so each of them
+is stored in a separate array of 16 bit values. AssemblyLines are reassembled when they are accessed.
+*/
+class AssemblyLines {
+	std::vector<uint16_t> addresses;
+	std::vector<uint16_t> opcodes;	//Index into instructions8085
+	std::vector<uint16_t> operands;
+
+public:
+	size_t size() const {
+		return addresses.size();
+	}
+
+	bool empty() const {
+		return addresses.empty();
+	}
+
+	void reserve(size_t n) {
+		addresses.reserve(n);
+		opcodes.reserve(n);
+		operands.reserve(n);
+	}
+
+	void clear() {
+		addresses.clear();
+		opcodes.clear();
+		operands.clear();
+	}
+
+	void swap(AssemblyLines &other) {
+		addresses.swap(other.addresses);
+		opcodes.swap(other.opcodes);
+		operands.swap(other.operands);
+	}
+
+	void push_back(const AssemblyLine &line) {
+		addresses.push_back((uint16_t)line.address);
+		opcodes.push_back((uint16_t)(line.instruction - instructions8085));
+		operands.push_back((uint16_t)line.operand);
+	}
+
+	void pop_back() {
+		addresses.pop_back();
+		opcodes.pop_back();
+		operands.pop_back();
+	}
+
+	/*
+	Appends all lines of another instance.
+	*/
+	void append(const AssemblyLines &other) {
+		addresses.insert(addresses.end(), other.addresses.begin(), other.addresses.end());
+		opcodes.insert(opcodes.end(), other.opcodes.begin(), other.opcodes.end());
+		operands.insert(operands.end(), other.operands.begin(), other.operands.end());
+	}
+
+	AssemblyLine operator[](size_t i) const {
+		return AssemblyLine(addresses[i], &(instructions8085[opcodes[i]]), operands[i]);
+	}
+
+	AssemblyLine back() const {
+		return (*this)[size() - 1];
+	}
+};
+
+/*
+Jump labels that get created automatically during decoding. Labels that did not exist before are remembered in new_labels,
+because they might point into an instruction that has already been decoded.
+Only the addresses of the labels are stored. Labels are named "j" followed by their address, unless they were created by a
+ret table, in which case the name is derived from the ret table label once it is needed.
+*/
+struct JumpLabels {
+
+	/*
+	The entry of a ret table that created a label. The label either points to the target of the entry, or to the start of the table.
+	*/
+	struct RetTableEntry {
+		unsigned int address;
+		bool table_start;
+
+		RetTableEntry(unsigned int address = 0, bool table_start = false) :
+			address(address),
+			table_start(table_start) {}
+	};
+
+	std::vector<bool> labels = std::vector<bool>(ADDRESS_SPACE_SIZE, false);
+	std::unordered_map<unsigned int, RetTableEntry> ret_labels;
+	std::vector<unsigned int> new_labels;
+
+	/*
+	Checks whether there is a jump label at the given address.
+	*/
+	bool contains(unsigned int address) const {
+		return address < ADDRESS_SPACE_SIZE && labels[address];
+	}
+
+	/*
+	Adds a label with a generated name, unless there already is a label at the given address.
+	*/
+	void add(unsigned int address);
+
+	/*
+	Adds a label that was created by the ret table entry at entry_address. Replaces the name of an existing label.
+	*/
+	void add_ret_label(unsigned int address, unsigned int entry_address, bool table_start);
+
+	/*
+	Returns the name of the label at the given address.
+	*/
+	std::string get_name(unsigned int address, const DSMInfo &info) const;
+
+	/*
+	Adds the labels of another instance. Names that were taken from ret tables take precedence over generated names,
+	so the result is the same as if all labels had been created by a single Decoder in address order.
+	*/
+	void merge(const JumpLabels &other);
+};
+
+/*
+The part of the input file that gets disassembled, together with the information that is shared by all Decoders working on it.
+*/
+struct DecoderInput {
+	//Bytes that get disassembled. The first byte is located at base_address.
+	const uint8_t *rom_begin = nullptr;
+	const uint8_t *rom_end = nullptr;
+	unsigned int base_address = 0;
+
+	const DSMInfo *info = nullptr;
+
+	//Marks the bytes that belong to reachable code when following the control flow. Empty if all code is disassembled. Indexed relative to base_address.
+	std::vector<bool> reachable;
+
+	//Marks the second byte of incomplete instructions, which gets output as a separate data byte, but is not decoded on its own.
+	//Indexed relative to base_address. Not a vector<bool>, so Decoders working on different ranges can write to it at the same time.
+	std::vector<uint8_t> continuation;
+
+	/*
+	Returns the number of bytes to disassemble.
+	*/
+	unsigned int size() const {
+		return (unsigned int)(rom_end - rom_begin);
+	}
+
+	/*
+	Checks whether the given address lies inside the input.
+	*/
+	bool contains(unsigned int address) const {
+		return address >= base_address && address - base_address < size();
+	}
+
+	/*
+	Checks whether the AssemblyLine at the given address is the second byte of an incomplete instruction.
+	*/
+	bool is_continuation(unsigned int address) const {
+		return contains(address) && continuation[address - base_address];
+	}
+};
+
+/*
+Reads AssemblyLines from the input. Every Decoder has its own position in the input, so multiple
+Decoders can work on different ranges of the same input at the same time, as long as they use separate JumpLabels.
+*/
+class Decoder {
+
+	DecoderInput &input;
+	JumpLabels &jump_labels;
+	const DSMInfo &info;
+
+	unsigned int current_address = 0;
+	const uint8_t *rom_pos = nullptr;
+
+	bool jump_label_at(unsigned int address) const;
+	void create_label_if_needed(const AssemblyLine &line);
+	bool can_read_as_operand(unsigned int address) const;
+	void add_data_instruction(AssemblyLines &lines, int instruction, int address, int data);
+	int fetch_byte();
+	void read_code_instruction(AssemblyLines &lines);
+
+public:
+	Decoder(DecoderInput &input, JumpLabels &jump_labels) :
+		input(input),
+		jump_labels(jump_labels),
+		info(*input.info)
+	{
+		seek(input.base_address);
+	}
+
+	/*
+	Moves the input position and the address counter to the given address.
+	*/
+	void seek(unsigned int address);
+
+	/*
+	Decodes a single instruction or data item at the current address and appends it to lines.
+	*/
+	void decode_next(AssemblyLines &lines);
+
+	/*
+	Returns the address of the next byte that will be decoded.
+	*/
+	unsigned int get_address() const {
+		return current_address;
+	}
+
+	/*
+	Checks whether the whole input has been decoded.
+	*/
+	bool at_end() const {
+		return rom_pos >= input.rom_end;
+	}
+};
+
+/*
+Decodes the whole input, creating AssemblyLines and jump labels. Segments are decoded separately using up to the given number of
+threads, and segments that depend on the segments before them are decoded again. The result is the same as a single pass over the
+input and does not depend on the number of threads.
+*/
+void decode_input(DecoderInput &input, JumpLabels &jump_labels, AssemblyLines &lines, unsigned int threads);
+
+/*
+Returns the jump labels that are used by the given AssemblyLines.
+*/
+std::unordered_map<unsigned int, std::string> used_jump_labels(const DecoderInput &input, const JumpLabels &jump_labels, const AssemblyLines &lines);
+
+#endif
\ No newline at end of file
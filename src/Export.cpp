@@ -0,0 +1,284 @@
+#include "Export.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ListingBuffer.h"
+
+static const char *data_type_names[] = { "undefined", "code", "bytes", "dwords_be", "dwords_le", "text", "ret" };
+
+/*
+Returns the name of the label at the address of the line, or an empty string if there is none.
+*/
+static std::string line_label(const AssemblyLine &line, const DSMInfo &info) {
+	Label *label = info.get_label(line.address);
+	if (label && label->start_address == line.address)
+		return label->get_jump_target_name(line.address);
+	return "";
+}
+
+/*
+Returns the name that the operand of the line is written as, or an empty string if the operand is not replaced by a label.
+*/
+static std::string operand_label(const AssemblyLine &line, const DSMInfo &info) {
+	int type = line.instruction->operand_type;
+	if (line.instruction->opcode == DATA_RET || (type != ADDRESS && type != IMMEDIATE_HYBRID))
+		return "";
+
+	Label *label = info.get_label(line.operand);
+	return label ? label->get_operand_name(line.operand) : "";
+}
+
+/*
+Returns the index of the segment containing the given address, or EXPORT_NONE.
+*/
+static uint32_t segment_index(unsigned int address, const DSMInfo &info) {
+	Segment *segment = info.get_segment(address);
+	if (!segment)
+		return EXPORT_NONE;
+
+	const std::vector<Segment *> &segments = info.get_segments();
+	return (uint32_t)(std::lower_bound(segments.begin(), segments.end(), segment,
+		[](Segment *a, Segment *b) { return a->start_address < b->start_address; }) - segments.begin());
+}
+
+//-------Binary-----------
+
+static_assert(sizeof(ExportHeader) == 40 && sizeof(ExportSegment) == 16 && sizeof(ExportLine) == 24, "Export records must not be padded");
+
+/*
+Collects the strings of the binary export. Every distinct string is only stored once.
+*/
+class StringTable {
+	std::vector<char> text;
+	std::unordered_map<std::string, uint32_t> offsets;
+
+public:
+	/*
+	Returns the offset of the given string, adding it if necessary. Empty strings are not stored.
+	*/
+	uint32_t add(const std::string &str) {
+		if (str.empty())
+			return EXPORT_NONE;
+
+		auto it = offsets.find(str);
+		if (it != offsets.end())
+			return it->second;
+
+		uint32_t offset = (uint32_t)text.size();
+		text.insert(text.end(), str.begin(), str.end());
+		text.push_back('\0');
+		offsets[str] = offset;
+		return offset;
+	}
+
+	const std::vector<char> &data() const {
+		return text;
+	}
+};
+
+static void put16(ListingBuffer &out, uint16_t v) {
+	out << (char)(v & 0xff) << (char)(v >> 8);
+}
+
+static void put32(ListingBuffer &out, uint32_t v) {
+	put16(out, (uint16_t)(v & 0xffff));
+	put16(out, (uint16_t)(v >> 16));
+}
+
+void write_binary_export(std::ostream &out, const AssemblyLines &lines, const DSMInfo &info) {
+	StringTable strings;
+	const std::vector<Segment *> &segments = info.get_segments();
+
+	ExportHeader header;
+	std::memcpy(header.magic, EXPORT_MAGIC, sizeof(header.magic));
+	header.version = EXPORT_VERSION;
+	header.segment_count = (uint32_t)segments.size();
+	header.segments_offset = sizeof(ExportHeader);
+	header.line_count = (uint32_t)lines.size();
+	header.lines_offset = header.segments_offset + header.segment_count * sizeof(ExportSegment);
+	header.strings_offset = header.lines_offset + header.line_count * sizeof(ExportLine);
+	header.reserved = 0;
+
+	ListingBuffer buffer(out);
+	buffer.append(header.magic, sizeof(header.magic));
+	put32(buffer, header.version);
+	put32(buffer, header.segment_count);
+	put32(buffer, header.segments_offset);
+	put32(buffer, header.line_count);
+	put32(buffer, header.lines_offset);
+	put32(buffer, header.strings_offset);
+
+	//The size of the string table is only known after all records have been created
+	ListingBuffer records;
+	for (Segment *s : segments) {
+		put32(records, s->start_address);
+		put32(records, s->end_address);
+		put32(records, s->type);
+		put32(records, strings.add(s->name));
+	}
+
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		Comment *comment = info.get_comment(line.address);
+
+		put16(records, (uint16_t)line.address);
+		put16(records, (uint16_t)line.operand);
+		put16(records, (uint16_t)(line.instruction - instructions8085));
+		records << (char)line.length();
+		records << (char)(line.instruction->instruction_type != DATA ? EXPORT_LINE_CODE : 0);
+		put32(records, strings.add(line_label(line, info)));
+		put32(records, strings.add(operand_label(line, info)));
+		put32(records, comment ? strings.add(comment->text) : EXPORT_NONE);
+		put32(records, segment_index(line.address, info));
+	}
+
+	//Pad the string table, so the file size stays a multiple of 4
+	const std::vector<char> &text = strings.data();
+	uint32_t padding = (4 - text.size() % 4) % 4;
+	put32(buffer, (uint32_t)text.size() + padding);
+	put32(buffer, header.reserved);
+
+	buffer.append(records);
+	buffer.append(text.data(), text.size());
+	for (uint32_t i = 0; i < padding; i++)
+		buffer << '\0';
+}
+
+//-------JSON-----------
+
+/*
+Returns the length of the well-formed UTF-8 sequence starting at str[i], or 0 if there is none. Overlong forms, surrogates and
+code points above U+10FFFF are not well-formed.
+*/
+static size_t utf8_length(const std::string &str, size_t i) {
+	unsigned char c = (unsigned char)str[i];
+	size_t length = 0;
+	unsigned char second_min = 0x80;
+	unsigned char second_max = 0xbf;
+	if (c >= 0xc2 && c <= 0xdf)
+		length = 2;
+	else if (c >= 0xe0 && c <= 0xef) {
+		length = 3;
+		if (c == 0xe0)
+			second_min = 0xa0;	//Overlong
+		else if (c == 0xed)
+			second_max = 0x9f;	//Surrogates
+	}
+	else if (c >= 0xf0 && c <= 0xf4) {
+		length = 4;
+		if (c == 0xf0)
+			second_min = 0x90;	//Overlong
+		else if (c == 0xf4)
+			second_max = 0x8f;	//Above U+10FFFF
+	}
+
+	if (length == 0 || i + length > str.length())
+		return 0;
+	unsigned char second = (unsigned char)str[i + 1];
+	if (second < second_min || second > second_max)
+		return 0;
+	for (size_t j = 2; j < length; j++) {
+		if (((unsigned char)str[i + j] & 0xc0) != 0x80)
+			return 0;
+	}
+	return length;
+}
+
+void write_json_string(ListingBuffer &out, const std::string &str) {
+	out << '"';
+	for (size_t i = 0; i < str.length(); i++) {
+		char c = str[i];
+		switch (c) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		case '\n':
+			out << "\\n";
+			break;
+		case '\r':
+			out << "\\r";
+			break;
+		case '\t':
+			out << "\\t";
+			break;
+		default:
+			if ((unsigned char)c < 0x20)
+				out << "\\u00" << Hex8(c);
+			else if ((unsigned char)c < 0x80)
+				out << c;
+			else {
+				//Bytes that are not valid UTF-8, such as the contents of binary data, are written as the code point with the same value
+				size_t length = utf8_length(str, i);
+				if (length == 0)
+					out << "\\u00" << Hex8((unsigned char)c);
+				else {
+					out.append(str.data() + i, length);
+					i += length - 1;
+				}
+			}
+		}
+	}
+	out << '"';
+}
+
+void write_json_line(ListingBuffer &out, const AssemblyLine &line, const DSMInfo &info) {
+	out << "{\"kind\":\"" << (line.instruction->instruction_type != DATA ? "code" : "data") << '"';
+	out << ",\"address\":" << std::to_string(line.address);
+	out << ",\"length\":" << std::to_string(line.length());
+	out << ",\"opcode\":" << std::to_string(line.instruction->opcode);
+
+	out << ",\"mnemonic\":";
+	write_json_string(out, line.instruction->name());
+
+	if (line.instruction->operand_length > 0)
+		out << ",\"operand\":" << std::to_string(line.operand);
+
+	std::string label = line_label(line, info);
+	if (!label.empty()) {
+		out << ",\"label\":";
+		write_json_string(out, label);
+	}
+
+	std::string target = operand_label(line, info);
+	if (!target.empty()) {
+		out << ",\"operand_label\":";
+		write_json_string(out, target);
+	}
+
+	Comment *comment = info.get_comment(line.address);
+	if (comment) {
+		out << ",\"comment\":";
+		write_json_string(out, comment->text);
+	}
+
+	Segment *segment = info.get_segment(line.address);
+	if (segment) {
+		out << ",\"segment\":";
+		write_json_string(out, segment->name);
+	}
+
+	out << '}';
+}
+
+void write_json_export(std::ostream &out, const AssemblyLines &lines, const DSMInfo &info) {
+	ListingBuffer buffer(out);
+
+	for (Segment *s : info.get_segments()) {
+		buffer << "{\"kind\":\"segment\",\"name\":";
+		write_json_string(buffer, s->name);
+		buffer << ",\"start\":" << std::to_string(s->start_address);
+		buffer << ",\"end\":" << std::to_string(s->end_address);
+		buffer << ",\"type\":\"" << data_type_names[s->type] << "\"}\n";
+	}
+
+	for (size_t i = 0; i < lines.size(); i++) {
+		write_json_line(buffer, lines[i], info);
+		buffer << '\n';
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <cstdint>
+#include <ostream>
+
+#include "Decoder.h"
+#include "DSMInfo.h"
+#include "ListingBuffer.h"
+
+//Identifies a file in the binary export format
+#define EXPORT_MAGIC "DSM85BIN"
+#define EXPORT_VERSION 1
+
+//Marks a string reference or segment index that is not present
+#define EXPORT_NONE 0xffffffff
+
+//Flags of ExportLine
+#define EXPORT_LINE_CODE 0x01
+
+/*
+Layout of the binary export format. All values are little-endian and every record is aligned to 4 bytes, so a mapped file can be
+accessed directly through these structs on little-endian machines. The file consists of an ExportHeader, followed by the segment
+records, the line records and a table of zero-terminated strings. Strings are referenced by their offset into the string table.
+*/
+struct ExportHeader {
+	char magic[8];	//EXPORT_MAGIC
+	uint32_t version;
+	uint32_t segment_count;
+	uint32_t segments_offset;	//File offsets of the sections
+	uint32_t line_count;
+	uint32_t lines_offset;
+	uint32_t strings_offset;
+	uint32_t strings_size;
+	uint32_t reserved;
+};
+
+struct ExportSegment {
+	uint32_t start_address;
+	uint32_t end_address;
+	uint32_t type;	//data_type
+	uint32_t name;
+};
+
+struct ExportLine {
+	uint16_t address;
+	uint16_t operand;
+	uint16_t opcode;	//Index into instructions8085. Pseudo-instructions start at DATA_BYTE.
+	uint8_t length;		//Number of bytes covered by the line
+	uint8_t flags;
+	uint32_t label;		//Label at the address of the line
+	uint32_t operand_label;	//Label that the operand refers to
+	uint32_t comment;
+	uint32_t segment;	//Index of the segment containing the line
+};
+
+/*
+Writes the AssemblyLines together with their labels, segments and comments in the binary export format.
+*/
+void write_binary_export(std::ostream &out, const AssemblyLines &lines, const DSMInfo &info);
+
+/*
+Writes a string as a JSON string literal.
+*/
+void write_json_string(ListingBuffer &out, const std::string &str);
+
+/*
+Writes an AssemblyLine together with its label, comment and segment as a JSON object, without a line break.
+*/
+void write_json_line(ListingBuffer &out, const AssemblyLine &line, const DSMInfo &info);
+
+/*
+Writes the segments, followed by the AssemblyLines together with their labels and comments, as one JSON object per line.
+*/
+void write_json_export(std::ostream &out, const AssemblyLines &lines, const DSMInfo &info);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "FileWatcher.h"
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//Time between two checks if the files are polled, in milliseconds
+#define POLL_INTERVAL 250
+
+//Time to wait after a change before the files are used, so editors can finish writing them, in milliseconds
+#define SETTLE_TIME 50
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+	notify_fd = inotify_init1(IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (notify_fd >= 0)
+		close(notify_fd);
+#endif
+}
+
+FileWatcher::FileState FileWatcher::read_state(const std::string &name) {
+	FileState state;
+	state.name = name;
+
+	struct stat st;
+	state.exists = stat(name.c_str(), &st) == 0;
+	state.modified = state.exists ? (long long)st.st_mtime : 0;
+	state.size = state.exists ? (long long)st.st_size : 0;
+#ifdef __linux__
+	//Include the sub-second part, so quick successive edits are noticed
+	if (state.exists)
+		state.modified = state.modified * 1000000000ll + st.st_mtim.tv_nsec;
+#endif
+	return state;
+}
+
+bool FileWatcher::is_changed(const FileState &state) {
+	FileState current = read_state(state.name);
+	return current.exists != state.exists || current.modified != state.modified || current.size != state.size;
+}
+
+bool FileWatcher::changed() const {
+	for (const FileState &f : files) {
+		if (is_changed(f))
+			return true;
+	}
+	return false;
+}
+
+/*
+Blocks until something might have changed.
+*/
+void FileWatcher::wait_for_event() {
+#ifdef __linux__
+	if (notify_fd >= 0) {
+		char events[4096];
+		if (read(notify_fd, events, sizeof(events)) > 0)
+			return;
+	}
+#endif
+	std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL));
+}
+
+std::vector<std::string> FileWatcher::take_changed_files() {
+	std::lock_guard<std::mutex> lock(files_mutex);
+	std::vector<std::string> changed_files;
+	std::vector<FileState> unchanged_files;
+	for (const FileState &f : files) {
+		if (is_changed(f))
+			changed_files.push_back(f.name);
+		else
+			unchanged_files.push_back(f);
+	}
+	files.swap(unchanged_files);
+	return changed_files;
+}
+
+void FileWatcher::add(const std::string &name) {
+	std::lock_guard<std::mutex> lock(files_mutex);
+	for (const FileState &f : files) {
+		if (f.name == name)
+			return;
+	}
+	files.push_back(read_state(name));
+
+#ifdef __linux__
+	//Watches are not removed when the set of files changes. Events from directories that are no longer relevant only lead to an extra check.
+	if (notify_fd >= 0) {
+		size_t separator = name.rfind('/');
+		std::string directory = separator == std::string::npos ? "." : name.substr(0, separator + 1);
+		inotify_add_watch(notify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MODIFY);
+	}
+#endif
+}
+
+void FileWatcher::wait() {
+	while (!changed())
+		wait_for_event();
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(SETTLE_TIME));
+}
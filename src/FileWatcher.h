@@ -0,0 +1,58 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+Waits for changes to a set of files. A file counts as changed if its modification time or size is different from when it
+was added, or if it was created or deleted since then. On Linux, inotify is used to wait for changes to the directories
+containing the files, which also catches editors that replace a file instead of writing to it. Elsewhere, the files are polled.
+*/
+class FileWatcher {
+
+	struct FileState {
+		std::string name;
+		bool exists;
+		long long modified;
+		long long size;
+	};
+
+	std::vector<FileState> files;
+	std::mutex files_mutex;
+
+	//inotify instance, or -1 if the files are polled
+	int notify_fd = -1;
+
+	static FileState read_state(const std::string &name);
+	static bool is_changed(const FileState &state);
+	bool changed() const;
+	void wait_for_event();
+
+public:
+	FileWatcher();
+	FileWatcher(const FileWatcher &) = delete;
+	FileWatcher &operator=(const FileWatcher &) = delete;
+	~FileWatcher();
+
+	/*
+	Returns the files that have changed since they were added, and stops watching them, so they get their new state when they
+	are added again.
+	*/
+	std::vector<std::string> take_changed_files();
+
+	/*
+	Starts watching a file, remembering its current state. Files should be added before they are read, so changes made while
+	they are being used are not missed. Adding a file that is already watched keeps its original state. Can be called from
+	multiple threads.
+	*/
+	void add(const std::string &name);
+
+	/*
+	Blocks until one of the watched files has changed.
+	*/
+	void wait();
+};
+
+#endif
\ No newline at end of file
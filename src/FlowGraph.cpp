@@ -0,0 +1,96 @@
+#include "FlowGraph.h"
+#include <algorithm>
+
+#include "ControlFlow.h"
+
+/*
+Checks whether the instruction is a call, which returns to the next instruction.
+*/
+static bool is_call(const Instruction *ins) {
+	return ins->opcode == 0xcd	//CALL
+		|| (ins->opcode & 0xc7) == 0xc4	//Conditional calls
+		|| (ins->opcode & 0xc7) == 0xc7	//RST n
+		|| ins->opcode == 0xcb;	//RSTV
+}
+
+/*
+Checks whether the AssemblyLine is code.
+*/
+static bool is_code(const AssemblyLine &line) {
+	return line.instruction->instruction_type != DATA;
+}
+
+void FlowGraph::build(const AssemblyLines &lines) {
+	blocks.clear();
+
+	//Mark the lines that start a block
+	std::vector<bool> target(ADDRESS_SPACE_SIZE, false);
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		unsigned int address = is_code(line) ? branch_target(line.instruction, line.operand) : NO_TARGET;
+		if (address < ADDRESS_SPACE_SIZE)
+			target[address] = true;
+	}
+
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		if (!is_code(line))
+			continue;
+
+		bool leader = i == 0 || target[line.address];
+		if (!leader) {
+			AssemblyLine prev = lines[i - 1];
+			leader = !is_code(prev) || prev.instruction->instruction_type == BRANCH || prev.address + prev.length() != line.address;
+		}
+
+		if (leader) {
+			BasicBlock block;
+			block.start_address = line.address;
+			block.first_line = (unsigned int)i;
+			blocks.push_back(block);
+		}
+		blocks.back().end_address = line.address + line.length() - 1;
+		blocks.back().end_line = (unsigned int)i + 1;
+	}
+
+	//Collect the successors of every block
+	successor_start.assign(1, 0);
+	successor_edges.clear();
+	for (size_t b = 0; b < blocks.size(); b++) {
+		AssemblyLine last = lines[blocks[b].end_line - 1];
+		const Instruction *ins = last.instruction;
+
+		if (falls_through(ins) && b + 1 < blocks.size() && blocks[b + 1].start_address == blocks[b].end_address + 1)
+			successor_edges.push_back(FlowEdge{ (unsigned int)b + 1, EDGE_FALLTHROUGH });
+
+		int next = find_block(branch_target(ins, last.operand));
+		if (next >= 0)
+			successor_edges.push_back(FlowEdge{ (unsigned int)next, (uint8_t)(is_call(ins) ? EDGE_CALL : EDGE_JUMP) });
+
+		successor_start.push_back((unsigned int)successor_edges.size());
+	}
+
+	//Invert the edges
+	predecessor_start.assign(blocks.size() + 1, 0);
+	for (const FlowEdge &e : successor_edges)
+		predecessor_start[e.block + 1]++;
+	for (size_t b = 0; b < blocks.size(); b++)
+		predecessor_start[b + 1] += predecessor_start[b];
+
+	predecessor_edges.resize(successor_edges.size());
+	std::vector<unsigned int> fill(predecessor_start.begin(), predecessor_start.end() - 1);
+	for (size_t b = 0; b < blocks.size(); b++) {
+		for (unsigned int i = 0; i < successor_count((unsigned int)b); i++) {
+			const FlowEdge &e = successor((unsigned int)b, i);
+			predecessor_edges[fill[e.block]++] = FlowEdge{ (unsigned int)b, e.kind };
+		}
+	}
+}
+
+int FlowGraph::find_block(unsigned int address) const {
+	auto it = std::lower_bound(blocks.begin(), blocks.end(), address,
+		[](const BasicBlock &b, unsigned int a) { return b.start_address < a; });
+	if (it == blocks.end() || it->start_address != address)
+		return -1;
+	return (int)(it - blocks.begin());
+}
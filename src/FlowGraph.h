@@ -0,0 +1,85 @@
+#ifndef FLOW_GRAPH_H
+#define FLOW_GRAPH_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Decoder.h"
+
+//Kinds of FlowEdges
+#define EDGE_FALLTHROUGH 0
+#define EDGE_JUMP 1
+#define EDGE_CALL 2
+
+/*
+A sequence of code lines that is only entered at its first line and only left after its last line.
+The lines are [first_line, end_line) of the AssemblyLines the graph was built from.
+*/
+struct BasicBlock {
+	unsigned int start_address;
+	unsigned int end_address;	//Last byte of the block
+	unsigned int first_line;
+	unsigned int end_line;
+};
+
+/*
+An edge between two BasicBlocks, given by the index of the block on the other end.
+*/
+struct FlowEdge {
+	unsigned int block;
+	uint8_t kind;
+};
+
+/*
+The basic-block control-flow graph of the decoded code. Blocks start at branch targets, after branches and at the first code line
+after data, and are sorted by address. Successor and predecessor edges are stored in compressed sparse row form.
+Calls and RST instructions have an EDGE_CALL edge to the called block as well as an EDGE_FALLTHROUGH edge to the next block.
+Returns and PCHL have no successors, since their targets are not known.
+*/
+class FlowGraph {
+
+	std::vector<BasicBlock> blocks;
+	std::vector<unsigned int> successor_start;
+	std::vector<FlowEdge> successor_edges;
+	std::vector<unsigned int> predecessor_start;
+	std::vector<FlowEdge> predecessor_edges;
+
+public:
+	/*
+	Builds the graph from the given AssemblyLines. Data lines do not belong to any block.
+	*/
+	void build(const AssemblyLines &lines);
+
+	const std::vector<BasicBlock> &get_blocks() const {
+		return blocks;
+	}
+
+	/*
+	Returns the index of the block starting at the given address, or -1 if no block starts there.
+	*/
+	int find_block(unsigned int address) const;
+
+	/*
+	Returns the number of successors of the given block.
+	*/
+	unsigned int successor_count(unsigned int block) const {
+		return successor_start[block + 1] - successor_start[block];
+	}
+
+	const FlowEdge &successor(unsigned int block, unsigned int i) const {
+		return successor_edges[successor_start[block] + i];
+	}
+
+	/*
+	Returns the number of predecessors of the given block.
+	*/
+	unsigned int predecessor_count(unsigned int block) const {
+		return predecessor_start[block + 1] - predecessor_start[block];
+	}
+
+	const FlowEdge &predecessor(unsigned int block, unsigned int i) const {
+		return predecessor_edges[predecessor_start[block] + i];
+	}
+};
+
+#endif
\ No newline at end of file
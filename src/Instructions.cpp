@@ -294,4 +294,19 @@ const Instruction instructions8085[] = {
 	Instruction(DATA_WORD,	".dw ",		DATA,	2,  IMMEDIATE),
 	Instruction(DATA_TEXT,	".text ",	DATA,	1,	CHARACTER),
 	Instruction(DATA_RET,	".rettbl ",	DATA,	2,	ADDRESS),
+};
+
+const InterruptVector interrupt_vectors[NUM_INTERRUPT_VECTORS] = {
+	InterruptVector("rst0",		0x00),
+	InterruptVector("rst1",		0x08),
+	InterruptVector("rst2",		0x10),
+	InterruptVector("rst3",		0x18),
+	InterruptVector("rst4",		0x20),
+	InterruptVector("trap",		0x24),
+	InterruptVector("rst5",		0x28),
+	InterruptVector("rst55",	0x2c),
+	InterruptVector("rst6",		0x30),
+	InterruptVector("rst65",	0x34),
+	InterruptVector("rst7",		0x38),
+	InterruptVector("rst75",	0x3c),
 };
\ No newline at end of file
@@ -30,8 +30,34 @@ struct Instruction {
 		instruction_type(instruction_type),
 		operand_length(operand_length),
 		operand_type(operand_type) {}
+
+	/*
+	Returns the mnemonic without the separator to the operand, e.g. "JP" instead of "JP ".
+	*/
+	std::string name() const {
+		std::string name = mnemonic;
+		while (!name.empty() && (name.back() == ' ' || name.back() == ','))
+			name.pop_back();
+		return name;
+	}
 };
 
 const extern Instruction instructions8085[260];
 
+#define NUM_INTERRUPT_VECTORS 12
+
+/*
+Name and address of an 8085 interrupt vector.
+*/
+struct InterruptVector {
+	const std::string name;
+	const unsigned int address;
+
+	InterruptVector(std::string name, unsigned int address) :
+		name(name),
+		address(address) {}
+};
+
+const extern InterruptVector interrupt_vectors[NUM_INTERRUPT_VECTORS];
+
 #endif
@@ -0,0 +1,35 @@
+#include "ListingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+void ListingBuffer::make_room(size_t n) {
+	if (out)
+		flush();
+	if (used + n > buffer.size())
+		buffer.resize(std::max(buffer.size() * 2, used + n));
+}
+
+void ListingBuffer::append(const char *str, size_t n) {
+	if (out && n > buffer.size()) {
+		//Too large for the buffer, so it is written directly
+		flush();
+		out->write(str, n);
+		return;
+	}
+	reserve(n);
+	std::memcpy(buffer.data() + used, str, n);
+	used += n;
+}
+
+void ListingBuffer::flush() {
+	if (!out)
+		return;
+	if (used > 0)
+		out->write(buffer.data(), used);
+	used = 0;
+}
+
+ListingBuffer &ListingBuffer::operator<<(const char *str) {
+	append(str, std::strlen(str));
+	return *this;
+}
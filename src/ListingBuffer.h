@@ -0,0 +1,129 @@
+#ifndef LISTING_BUFFER_H
+#define LISTING_BUFFER_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+//Default size of the buffer of a ListingBuffer
+#define LISTING_BUFFER_SIZE 0x40000
+
+/*
+Wraps a value that is written as 4 hex digits.
+*/
+struct Hex16 {
+	int value;
+
+	explicit Hex16(int value) : value(value) {}
+};
+
+/*
+Wraps a value that is written as 2 hex digits.
+*/
+struct Hex8 {
+	int value;
+
+	explicit Hex8(int value) : value(value) {}
+};
+
+/*
+Collects the text of a listing in a large buffer and writes it to the output stream in big blocks. Unlike std::endl, line breaks
+do not flush anything, and hex values are formatted directly into the buffer without creating temporary strings.
+The remaining text is written when flush() is called or the ListingBuffer is destroyed.
+A ListingBuffer without an output stream keeps all text in memory, so parts of a listing can be rendered separately.
+*/
+class ListingBuffer {
+
+	std::ostream *out;
+	std::vector<char> buffer;
+	size_t used = 0;
+
+	/*
+	Makes room for at least n more characters.
+	*/
+	void reserve(size_t n) {
+		if (used + n > buffer.size())
+			make_room(n);
+	}
+
+	/*
+	Flushes the buffer, or grows it if there is no output stream.
+	*/
+	void make_room(size_t n);
+
+public:
+	explicit ListingBuffer(std::ostream &out, size_t capacity = LISTING_BUFFER_SIZE) :
+		out(&out),
+		buffer(capacity) {}
+
+	/*
+	Creates a ListingBuffer that keeps all text in memory.
+	*/
+	ListingBuffer() :
+		out(nullptr) {}
+
+	ListingBuffer(const ListingBuffer &) = delete;
+	ListingBuffer &operator=(const ListingBuffer &) = delete;
+
+	~ListingBuffer() {
+		flush();
+	}
+
+	/*
+	Appends n characters.
+	*/
+	void append(const char *str, size_t n);
+
+	/*
+	Appends the text of a ListingBuffer that keeps its text in memory.
+	*/
+	void append(const ListingBuffer &other) {
+		append(other.buffer.data(), other.used);
+	}
+
+	/*
+	Returns the buffered characters.
+	*/
+	std::string contents() const {
+		return std::string(buffer.data(), used);
+	}
+
+	/*
+	Writes all buffered characters to the output stream. Does nothing if there is no output stream.
+	*/
+	void flush();
+
+	ListingBuffer &operator<<(char c) {
+		reserve(1);
+		buffer[used++] = c;
+		return *this;
+	}
+
+	ListingBuffer &operator<<(const char *str);
+
+	ListingBuffer &operator<<(const std::string &str) {
+		append(str.data(), str.length());
+		return *this;
+	}
+
+	ListingBuffer &operator<<(Hex16 h) {
+		reserve(4);
+		buffer[used++] = hex_digits[(h.value >> 12) & 0xf];
+		buffer[used++] = hex_digits[(h.value >> 8) & 0xf];
+		buffer[used++] = hex_digits[(h.value >> 4) & 0xf];
+		buffer[used++] = hex_digits[h.value & 0xf];
+		return *this;
+	}
+
+	ListingBuffer &operator<<(Hex8 h) {
+		reserve(2);
+		buffer[used++] = hex_digits[(h.value >> 4) & 0xf];
+		buffer[used++] = hex_digits[h.value & 0xf];
+		return *this;
+	}
+};
+
+#endif
\ No newline at end of file
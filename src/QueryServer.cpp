@@ -0,0 +1,281 @@
+#include "QueryServer.h"
+#include <cctype>
+#include <stdexcept>
+
+#include "Export.h"
+#include "util.h"
+
+/*
+Appends the UTF-8 encoding of a code point to str.
+*/
+static void append_utf8(std::string &str, unsigned int code_point) {
+	if (code_point < 0x80)
+		str += (char)code_point;
+	else if (code_point < 0x800) {
+		str += (char)(0xc0 | (code_point >> 6));
+		str += (char)(0x80 | (code_point & 0x3f));
+	}
+	else if (code_point < 0x10000) {
+		str += (char)(0xe0 | (code_point >> 12));
+		str += (char)(0x80 | ((code_point >> 6) & 0x3f));
+		str += (char)(0x80 | (code_point & 0x3f));
+	}
+	else {
+		str += (char)(0xf0 | (code_point >> 18));
+		str += (char)(0x80 | ((code_point >> 12) & 0x3f));
+		str += (char)(0x80 | ((code_point >> 6) & 0x3f));
+		str += (char)(0x80 | (code_point & 0x3f));
+	}
+}
+
+/*
+Reads a JSON object with string, number and literal values from a single line. Nested objects and arrays are not supported.
+String values are unescaped, all other values are kept as they are written. Returns false if the line is not such an object.
+*/
+static bool parse_request(const std::string &line, std::unordered_map<std::string, std::string> &fields) {
+	size_t pos = 0;
+	auto skip_space = [&]() {
+		while (pos < line.length() && (line[pos] == ' ' || line[pos] == '\t' || line[pos] == '\r'))
+			pos++;
+	};
+	//Reads the four hex digits of a \u escape, starting after the 'u'
+	auto read_code_unit = [&](unsigned int &value) -> bool {
+		value = 0;
+		for (int i = 0; i < 4; i++) {
+			if (++pos >= line.length() || !std::isxdigit((unsigned char)line[pos]))
+				return false;
+			char c = (char)std::tolower((unsigned char)line[pos]);
+			value = value * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+		}
+		return true;
+	};
+	auto read_string = [&](std::string &str) -> bool {
+		if (pos >= line.length() || line[pos] != '"')
+			return false;
+		for (pos++; pos < line.length() && line[pos] != '"'; pos++) {
+			if (line[pos] != '\\') {
+				str += line[pos];
+				continue;
+			}
+			if (++pos >= line.length())
+				return false;
+			switch (line[pos]) {
+			case 'b': str += '\b'; break;
+			case 'f': str += '\f'; break;
+			case 'n': str += '\n'; break;
+			case 'r': str += '\r'; break;
+			case 't': str += '\t'; break;
+			case 'u': {
+				unsigned int code_point;
+				if (!read_code_unit(code_point) || (code_point >= 0xdc00 && code_point < 0xe000))
+					return false;
+				if (code_point >= 0xd800 && code_point < 0xdc00) {
+					//Characters outside the basic multilingual plane are written as a surrogate pair
+					unsigned int low;
+					if (pos + 2 >= line.length() || line[pos + 1] != '\\' || line[pos + 2] != 'u')
+						return false;
+					pos += 2;
+					if (!read_code_unit(low) || low < 0xdc00 || low >= 0xe000)
+						return false;
+					code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+				}
+				append_utf8(str, code_point);
+				break;
+			}
+			default: str += line[pos];
+			}
+		}
+		return pos++ < line.length();
+	};
+
+	skip_space();
+	if (pos >= line.length() || line[pos++] != '{')
+		return false;
+	skip_space();
+	if (pos < line.length() && line[pos] == '}')
+		return true;
+
+	while (true) {
+		std::string key, value;
+		skip_space();
+		if (!read_string(key))
+			return false;
+		skip_space();
+		if (pos >= line.length() || line[pos++] != ':')
+			return false;
+		skip_space();
+		if (pos < line.length() && line[pos] == '"') {
+			if (!read_string(value))
+				return false;
+		}
+		else {
+			while (pos < line.length() && line[pos] != ',' && line[pos] != '}' && line[pos] != ' ')
+				value += line[pos++];
+			if (value.empty())
+				return false;
+		}
+		fields[key] = value;
+
+		skip_space();
+		if (pos >= line.length())
+			return false;
+		if (line[pos] == '}')
+			return true;
+		if (line[pos++] != ',')
+			return false;
+	}
+}
+
+/*
+Reads an address field of a request.
+*/
+static unsigned int request_address(const std::unordered_map<std::string, std::string> &request, const std::string &field) {
+	auto it = request.find(field);
+	if (it == request.end())
+		throw std::invalid_argument("Missing field: " + field);
+	int address = 0;
+	try {
+		address = parse_int_literal(it->second);
+	}
+	catch (std::logic_error &) {
+		//Thrown by std::stoi for malformed or too large literals
+		throw std::invalid_argument("Invalid address: " + it->second);
+	}
+	if (address < 0 || address >= ADDRESS_SPACE_SIZE)
+		throw std::invalid_argument("Address out of range: " + it->second);
+	return (unsigned int)address;
+}
+
+QueryServer::QueryServer(const AssemblyLines &lines, const DSMInfo &info, const XrefIndex &xrefs,
+	std::function<void(size_t first, size_t end, ListingBuffer &out)> render) :
+	lines(lines),
+	info(info),
+	xrefs(xrefs),
+	render(render)
+{
+	for (unsigned int address = 0; address < ADDRESS_SPACE_SIZE; address++) {
+		Label *label = info.get_label(address);
+		if (label && label->start_address == address)
+			label_addresses.emplace(label->get_jump_target_name(address), address);
+	}
+}
+
+/*
+Returns the index of the first line that ends after the given address, or the number of lines if there is none.
+*/
+size_t QueryServer::find_line(unsigned int address) const {
+	size_t low = 0;
+	size_t high = lines.size();
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		AssemblyLine line = lines[mid];
+		if (line.address + line.length() <= address)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+/*
+Writes the fields of the response to a request, after the "ok" field. Returns false and sets error if the request can not be answered.
+*/
+bool QueryServer::answer(const std::unordered_map<std::string, std::string> &request, ListingBuffer &out, std::string &error) const {
+	auto query = request.find("query");
+	if (query == request.end()) {
+		error = "Missing field: query";
+		return false;
+	}
+
+	if (query->second == "address") {
+		unsigned int address = request_address(request, "address");
+		size_t i = find_line(address);
+		if (i == lines.size() || lines[i].address > address) {
+			error = "Address is not part of the disassembly";
+			return false;
+		}
+		out << ",\"line\":";
+		write_json_line(out, lines[i], info);
+	}
+	else if (query->second == "label") {
+		auto name = request.find("name");
+		auto it = name != request.end() ? label_addresses.find(name->second) : label_addresses.end();
+		if (it == label_addresses.end()) {
+			error = "Unknown label";
+			return false;
+		}
+		out << ",\"address\":" << std::to_string(it->second);
+	}
+	else if (query->second == "xrefs") {
+		unsigned int address = request_address(request, "address");
+		out << ",\"xrefs\":[";
+		for (unsigned int i = 0; i < xrefs.count(address); i++) {
+			if (i > 0)
+				out << ',';
+			out << "{\"address\":" << std::to_string(xrefs.source(address, i)) << ",\"mnemonic\":";
+			write_json_string(out, xrefs.instruction(address, i)->name());
+			out << '}';
+		}
+		out << ']';
+	}
+	else if (query->second == "render") {
+		unsigned int start = request_address(request, "start");
+		unsigned int end = request_address(request, "end");
+		size_t first = find_line(start);
+		size_t last = find_line(end + 1);
+
+		ListingBuffer text;
+		if (first < last)
+			render(first, last, text);
+		out << ",\"text\":";
+		write_json_string(out, text.contents());
+	}
+	else {
+		error = "Unknown query: " + query->second;
+		return false;
+	}
+	return true;
+}
+
+void QueryServer::serve(std::istream &in, std::ostream &out) {
+	ListingBuffer response(out);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (line.find_first_not_of(" \t\r") == std::string::npos)
+			continue;
+
+		std::unordered_map<std::string, std::string> request;
+		ListingBuffer fields;
+		std::string error;
+		bool ok = false;
+		if (!parse_request(line, request))
+			error = "Malformed request";
+		else {
+			try {
+				ok = answer(request, fields, error);
+			}
+			catch (std::logic_error &e) {
+				error = e.what();
+			}
+		}
+
+		response << '{';
+		auto id = request.find("id");
+		if (id != request.end()) {
+			response << "\"id\":";
+			write_json_string(response, id->second);
+			response << ',';
+		}
+		if (ok) {
+			response << "\"ok\":true";
+			response.append(fields);
+		}
+		else {
+			response << "\"ok\":false,\"error\":";
+			write_json_string(response, error);
+		}
+		response << '}' << '\n';
+		response.flush();
+		out.flush();
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include "Decoder.h"
+#include "DSMInfo.h"
+#include "ListingBuffer.h"
+#include "Xref.h"
+
+/*
+Answers queries about a disassembly that is kept in memory. Every request is a JSON object on a single line, and every
+response is a single line as well. Requests have a "query" field, and may have an "id" field that is copied to the response as a string.
+Addresses can be given as numbers or as strings containing an integer literal, e.g. "$1234".
+
+{"query":"address","address":A}           The line containing address A.
+{"query":"label","name":N}                The address of the label named N.
+{"query":"xrefs","address":A}             The instructions that refer to address A.
+{"query":"render","start":A,"end":B}      The listing text of the lines from address A to B (inclusive).
+
+Responses have an "ok" field. If it is false, the "error" field describes the problem.
+*/
+class QueryServer {
+
+	const AssemblyLines &lines;
+	const DSMInfo &info;
+	const XrefIndex &xrefs;
+
+	//Writes the listing text of the lines [first, end)
+	std::function<void(size_t first, size_t end, ListingBuffer &out)> render;
+
+	std::unordered_map<std::string, unsigned int> label_addresses;
+
+	size_t find_line(unsigned int address) const;
+	bool answer(const std::unordered_map<std::string, std::string> &request, ListingBuffer &out, std::string &error) const;
+
+public:
+	QueryServer(const AssemblyLines &lines, const DSMInfo &info, const XrefIndex &xrefs,
+		std::function<void(size_t first, size_t end, ListingBuffer &out)> render);
+
+	/*
+	Answers requests from in until it ends.
+	*/
+	void serve(std::istream &in, std::ostream &out);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "RomImage.h"
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+Tries to memory-map the file. Returns false if mapping is not possible, in which case the caller should fall back to reading the file.
+*/
+static bool map_file(const std::string &filename, void *&mapping, size_t &length) {
+#ifndef _WIN32
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void *m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	//The mapping stays valid after the descriptor is closed
+	if (m == MAP_FAILED)
+		return false;
+
+	mapping = m;
+	length = (size_t)st.st_size;
+	return true;
+#else
+	(void)filename;
+	(void)mapping;
+	(void)length;
+	return false;
+#endif
+}
+
+bool RomImage::open(const std::string &filename) {
+	close();
+
+	if (map_file(filename, mapping, length)) {
+		bytes = (const uint8_t *)mapping;
+		return true;
+	}
+
+	//Fallback: read the whole file into memory at once
+	std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
+	if (in.fail())
+		return false;
+
+	in.seekg(0, std::ios_base::end);
+	std::streamoff file_length = in.tellg();
+	in.seekg(0, std::ios_base::beg);
+	if (file_length < 0)
+		return false;
+
+	buffer.resize((size_t)file_length);
+	if (file_length > 0)
+		in.read((char *)buffer.data(), file_length);
+
+	bytes = buffer.data();
+	length = (size_t)in.gcount();
+	return true;
+}
+
+bool RomImage::read(std::istream &in, size_t skip, size_t max_length) {
+	close();
+
+	//Discard the bytes in front of the image in small pieces
+	char discard[4096];
+	while (skip > 0 && in) {
+		in.read(discard, (std::streamsize)std::min(skip, sizeof(discard)));
+		skip -= (size_t)in.gcount();
+		first += (size_t)in.gcount();
+	}
+
+	buffer.resize(max_length);
+	if (skip == 0 && max_length > 0) {
+		in.read((char *)buffer.data(), (std::streamsize)max_length);
+		buffer.resize((size_t)in.gcount());
+	}
+	else
+		buffer.clear();
+
+	bytes = buffer.data();
+	length = buffer.size();
+	return !in.bad();
+}
+
+void RomImage::close() {
+#ifndef _WIN32
+	if (mapping)
+		munmap(mapping, length);
+#endif
+	mapping = nullptr;
+	bytes = nullptr;
+	length = 0;
+	first = 0;
+	buffer.clear();
+}
@@ -0,0 +1,73 @@
+#ifndef ROM_IMAGE_H
+#define ROM_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+/*
+A read-only view of the input file. The whole file is made available as a single contiguous block of bytes, so the disassembler
+can decode directly from memory instead of pulling one byte at a time out of a stream. Where the platform supports it, the file is
+memory-mapped. Otherwise it is read into a buffer in one go.
+An image can also be read from a stream that can not be seeked, such as stdin. In that case only the requested part of the stream
+is kept, and data() points to the byte at offset() in the stream.
+*/
+class RomImage {
+
+	const uint8_t *bytes = nullptr;
+	size_t length = 0;
+	size_t first = 0;
+
+	//Backing storage if the file could not be mapped
+	std::vector<uint8_t> buffer;
+
+	//Mapping handle, or nullptr if the file is not mapped
+	void *mapping = nullptr;
+
+	void close();
+
+public:
+	RomImage() = default;
+	RomImage(const RomImage &) = delete;
+	RomImage &operator=(const RomImage &) = delete;
+
+	~RomImage() {
+		close();
+	}
+
+	/*
+	Loads the given file. Returns false if the file could not be opened.
+	*/
+	bool open(const std::string &filename);
+
+	/*
+	Reads at most max_length bytes from the stream, starting skip bytes into it. The skipped bytes are discarded as they are read.
+	Returns false if the stream could not be read.
+	*/
+	bool read(std::istream &in, size_t skip, size_t max_length);
+
+	/*
+	Returns a pointer to the first byte of the image.
+	*/
+	const uint8_t *data() const {
+		return bytes;
+	}
+
+	/*
+	Returns the number of bytes in the image.
+	*/
+	size_t size() const {
+		return length;
+	}
+
+	/*
+	Returns the position of the first byte of the image in the file.
+	*/
+	size_t offset() const {
+		return first;
+	}
+};
+
+#endif
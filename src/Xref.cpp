@@ -0,0 +1,32 @@
+#include "Xref.h"
+
+/*
+Checks whether the operand of an instruction refers to an address.
+*/
+static bool is_reference(const Instruction *ins) {
+	return ins->instruction_type != DATA && (ins->operand_type == ADDRESS || ins->operand_type == IMMEDIATE_HYBRID);
+}
+
+void XrefIndex::build(const AssemblyLines &lines) {
+	//Count the references to every target, then turn the counts into start indices
+	start.assign(ADDRESS_SPACE_SIZE + 1, 0);
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		if (is_reference(line.instruction))
+			start[line.operand + 1]++;
+	}
+	for (unsigned int a = 0; a < ADDRESS_SPACE_SIZE; a++)
+		start[a + 1] += start[a];
+
+	sources.resize(start[ADDRESS_SPACE_SIZE]);
+	opcodes.resize(start[ADDRESS_SPACE_SIZE]);
+	std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+	for (size_t i = 0; i < lines.size(); i++) {
+		AssemblyLine line = lines[i];
+		if (is_reference(line.instruction)) {
+			uint32_t index = fill[line.operand]++;
+			sources[index] = (uint16_t)line.address;
+			opcodes[index] = (uint8_t)line.instruction->opcode;
+		}
+	}
+}
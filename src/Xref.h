@@ -0,0 +1,48 @@
+#ifndef XREF_H
+#define XREF_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Decoder.h"
+
+/*
+Cross references from instructions to the addresses in their operands. Covers branches, loads and stores with an address operand,
+and LXI instructions. The references are stored in compressed sparse row form: the sources of all references to a target address
+are found at the indices [start[target], start[target + 1]) of the sources and opcodes arrays, in address order.
+*/
+class XrefIndex {
+
+	std::vector<uint32_t> start;
+	std::vector<uint16_t> sources;
+	std::vector<uint8_t> opcodes;
+
+public:
+	/*
+	Collects the references of all code lines.
+	*/
+	void build(const AssemblyLines &lines);
+
+	/*
+	Returns the number of references to the given address.
+	*/
+	unsigned int count(unsigned int target) const {
+		return target < ADDRESS_SPACE_SIZE && !start.empty() ? start[target + 1] - start[target] : 0;
+	}
+
+	/*
+	Returns the address of the i-th instruction that refers to the given address.
+	*/
+	unsigned int source(unsigned int target, unsigned int i) const {
+		return sources[start[target] + i];
+	}
+
+	/*
+	Returns the instruction of the i-th reference to the given address.
+	*/
+	const Instruction *instruction(unsigned int target, unsigned int i) const {
+		return &(instructions8085[opcodes[start[target] + i]]);
+	}
+};
+
+#endif
\ No newline at end of file
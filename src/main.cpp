@@ -6,12 +6,36 @@
 #include <vector>
 #include <unordered_map>
 #include <utility>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "Instructions.h"
 #include "ArgumentParser.h"
 #include "util.h"
 #include "parser/Parser.h"
 #include "DSMInfo.h"
+#include "RomImage.h"
+#include "Decoder.h"
+#include "ControlFlow.h"
+#include "BranchScan.h"
+#include "ListingBuffer.h"
+#include "BoundedQueue.h"
+#include "Export.h"
+#include "Xref.h"
+#include "FlowGraph.h"
+#include "CacheDirectory.h"
+#include "DecodeCache.h"
+#include "FileWatcher.h"
+#include "QueryServer.h"
 
 #define VERSION_MAJOR 1
 #define VERSION_MINOR 0
@@ -21,32 +45,42 @@
 #define INDENT "    "
 #define LABEL_LIMIT 7
 
+//Number of AssemblyLines that are rendered together when writing the listing
+#define LISTING_CHUNK_SIZE 4096
+
+//Number of chunks that can wait between two stages of the pipelined listing
+#define PIPELINE_QUEUE_SIZE 4
+
+//Number of addresses whose lines are rendered together when the rendered listing is kept in the cache
+#define CACHED_CHUNK_ADDRESSES 1024
+
+//Extension of rendered parts of the listing in the CacheDirectory
+#define LISTING_EXTENSION ".dsmr"
+
 //Error codes
 #define NO_ERROR 0
 #define ERROR_FILE_NOT_FOUND 1
 #define ERROR_BAD_ARGUMENTS 2
 #define ERROR_BAD_LABEL_FILE 3
 
-/*
-A single Assembly line, consisting of an address, an instruction and an operand.
-*/
-struct AssemblyLine {
-	const unsigned int address;
-	const Instruction *instruction;
-	const int operand;
+JumpLabels jump_labels;
 
-	AssemblyLine(const unsigned int address, const Instruction *instruction, const int operand) :
-		address(address), instruction(instruction), operand(operand) {}
-};
+DSMInfo info;
 
-std::unordered_map<unsigned int, std::string> first_pass_labels;
-std::unordered_map<unsigned int, std::string> second_pass_labels;
+DecoderInput input;
 
-std::unordered_map<unsigned int, std::string> *label_output;
+AssemblyLines instructions;
 
-DSMInfo info;
+//Whether instructions holds the result of decoding, and the DecodeCache key it belongs to
+bool decoded = false;
+uint64_t decoded_key = 0;
+
+XrefIndex xrefs;
 
-std::vector<AssemblyLine> instructions;
+//Label files parsed in earlier rounds of watch mode, which are reused as long as they do not change
+std::unordered_map<std::string, ParsedFile> parsed_label_files;
+
+FlowGraph flow_graph;
 
 // Command line parameters
 unsigned int start_address = 0;
@@ -56,450 +90,593 @@ unsigned int input_length = MAX_ADDRESS;
 bool add_address_column = false;
 bool print_help = false;
 bool hw_labels = false;
+bool follow_control_flow = false;
+bool superset = false;
+bool list_jumps = false;
+bool pipelined = false;
+bool list_xrefs = false;
+bool watch = false;
+bool serve = false;
+unsigned int threads = 1;
 std::string output_file = "";
 std::string labels_file = "";
+std::string export_name = "";
+std::string graph_name = "";
+std::string cache_directory = "";
 
-unsigned int current_address = 0;
-
-unsigned int data_instruction_streak = 0;
+/*
+State of the merging of successive data instructions into a single line.
+*/
+struct DataLineState {
+	unsigned int data_instruction_streak = 0;
+	int prev_opcode = -1;
+};
 
 /*
 ================================
-           READ INPUT
+		  WRITE OUTPUT
 ================================
 */
 
 /*
-Checks if there is a label pointing to the given address. Since the disassembler uses two lists, both have to be checked.
+Checks if there is a label pointing to the given address. Both user-defined and automatically created labels have to be checked.
 */
 static bool jump_label_at(unsigned int address) {
-	return (info.label_at(address) && info.get_label(address)->jump_label)
-		|| first_pass_labels.find(address) != first_pass_labels.end()
-		|| second_pass_labels.find(address) != second_pass_labels.end();
-}
-
-/*
-Creates a new label to the target address if the given AssemblyLine is BRANCH type instruction.
-*/
-static void create_label_if_needed(const AssemblyLine &line) {
-	if (line.instruction->instruction_type == BRANCH
-		&& line.instruction->operand_length > 0
-		&& label_output->find(line.operand) == label_output->end())
-	{
-		std::string label = "j" + hex16bit(line.operand);
-		(*label_output)[line.operand] = label;
-	}
-}
-
-/*
-Checks whether the byte at a given address can be read in as an operand. A byte cannot be an operand if
-1) it is outside the range that should be read (as specified by start_address and end_address)
-2) there is a jump label pointing to that address, which means that a new instruction has to start there.
-3) a new segment starts at that address
-4) the instruction has a comment
-*/
-static bool can_read_as_operand(unsigned int address) {
-	//start_address and end_address are relative to the input file, while the address parameter is based on base_address.
-	if (address<base_address || address>base_address + end_address - start_address)
-		return false;
-	if (jump_label_at(address))
-		return false;
-	if (info.is_segment_start())
-		return false;
-	if (info.has_comment())
-		return false;
-	return true;
-}
-
-/*
-Adds a pseudo-instruction.
-*/
-static void add_data_instruction(int instruction, int address, int data) {
-	AssemblyLine pseudo(address, &(instructions8085[instruction]), data);
-	instructions.push_back(std::move(pseudo));
-}
-
-/*
-Fetches a single byte from the input stream, increments address counter, advances final_labels DSMInfo instance.
-*/
-static int fetch_byte(std::istream &rom_stream) {
-	current_address++;
-	info.advance();
-	return rom_stream.get();
-}
-
-/*
-Reads a single instruction from the input stream. The instruction may be multiple bytes long, depending on the opcode.
-Advances the current_address counter accordingly.
-*/
-static void read_code_instruction(std::istream &rom_stream) {
-	int address = current_address;
-	bool segment_end = info.is_segment_end();
-
-	int opcode = fetch_byte(rom_stream);
-	const Instruction *ins = &(instructions8085[opcode]);
-	int operand = 0;
-
-	if (ins->operand_length == 1) {
-		if (!can_read_as_operand(current_address) || segment_end) {
-			//Output incomplete instruction (data byte) if the next byte could not be read as an operand
-			add_data_instruction(DATA_BYTE, address, opcode);
-			return;
-		}
-		else {
-			operand = fetch_byte(rom_stream);
-		}
-	}
-	else if (ins->operand_length == 2) {
-		//Read first operand byte
-		if (!can_read_as_operand(current_address) || segment_end) {
-			//Output incomplete instruction
-			add_data_instruction(DATA_BYTE, address, opcode);
-			return;
-		}
-		else {
-			//Check if segment ends on the first of the two operand bytes
-			segment_end = info.is_segment_end();
-
-			//first (least significant) byte of a two byte operand
-			operand = fetch_byte(rom_stream);
-		}
-
-		//Read second operand byte
-		if (!can_read_as_operand(current_address) || segment_end) {
-			//Output two incomplete instructions
-			add_data_instruction(DATA_BYTE, address, opcode);
-			add_data_instruction(DATA_BYTE, address + 1, opcode);
-			return;
-		}
-		else {
-			//second (most significant) byte of a two byte operand
-			operand |= fetch_byte(rom_stream) << 8;
-		}
-	}
-
-	//Create AssemblyLine and add label
-	AssemblyLine line(address, ins, operand);
-	create_label_if_needed(line);
-
-	instructions.push_back(std::move(line));
-}
-
-/*
-Do a single pass over the input file, creating AssemblyLines and labels.
-*/
-static void single_pass(std::istream &rom_stream) {
-	instructions.clear();
-	info.reset(base_address);
-
-	//Set stream pointer to start address
-	rom_stream.clear();
-	rom_stream.seekg(start_address);
-
-	//Read instructions
-	current_address = base_address;
-	while (!rom_stream.eof() && rom_stream.tellg() <= end_address) {
-		int address = current_address;
-		int data = 0;
-
-		switch (info.get_data_type()) {
-		case CODE_T:
-			read_code_instruction(rom_stream);
-			break;
-		case BYTES_T:
-			data = fetch_byte(rom_stream);
-			add_data_instruction(DATA_BYTE, address, data);
-			break;
-		case DWORDS_BE_T:
-			data = fetch_byte(rom_stream);
-			if (info.get_data_type() == DWORDS_BE_T) {
-				data = (data << 8) | (fetch_byte(rom_stream) & 0xff);
-				add_data_instruction(DATA_WORD, address, data);
-			}
-			else {
-				add_data_instruction(DATA_BYTE, address, data);
-			}
-			break;
-		case DWORDS_LE_T:
-			data = fetch_byte(rom_stream);
-			if (info.get_data_type() == DWORDS_LE_T) {
-				data = (fetch_byte(rom_stream) << 8) | (data & 0xff);
-				add_data_instruction(DATA_WORD, address, data);
-			}
-			else {
-				add_data_instruction(DATA_BYTE, address, data);
-			}
-			break;
-		case TEXT_T:
-			data = fetch_byte(rom_stream);
-			add_data_instruction(DATA_TEXT, address, data);
-			break;
-		case RET_T:
-			data = fetch_byte(rom_stream);
-			if (info.get_data_type() == RET_T) {
-				data = (fetch_byte(rom_stream) << 8) | (data & 0xff);
-				add_data_instruction(DATA_RET, address, data);
-				IndirectLabel *il = (IndirectLabel *) info.get_label(address);
-				(*label_output)[data] = il->get_jump_target_name(address) + "[" + std::to_string(il->get_offset()) + "]";
-				(*label_output)[il->start_address] = il->get_jump_target_name(address);
-			}
-			else {
-				add_data_instruction(DATA_BYTE, address, data);
-			}
-			break;
-		default:
-			//Should never happen
-			std::cerr << "Error: info.get_data_type() returned undefined type (UNDEFINED_T)" << std::endl;
-		}
-	}
+	return info.jump_label_at(address) || jump_labels.contains(address);
 }
 
-/*
-================================
-		  WRITE OUTPUT
-================================
-*/
-
 /*
 Writes the operand of an AssemblyLine. If the operand is an address for which a label exist, the label is printed.
 */
-static void write_operand(const AssemblyLine &line, std::ostream &listing_stream) {
+static void write_operand(const AssemblyLine &line, ListingBuffer &listing) {
 	Label *label = nullptr;
 	switch (line.instruction->operand_type) {
 	case ADDRESS:
 		label = info.get_label(line.operand);
 		if (label)	//Print label
-			listing_stream << label->get_operand_name(line.operand);
+			listing << label->get_operand_name(line.operand);
 		else
-			listing_stream << "$" << hex16bit(line.operand);
+			listing << '$' << Hex16(line.operand);
 		break;
 	case IMMEDIATE_HYBRID:
 		label = info.get_label(line.operand);
 		if (label)	//Print label
-			listing_stream << label->get_operand_name(line.operand) << '(';
+			listing << label->get_operand_name(line.operand) << '(';
 
 		if (line.instruction->operand_length == 2)
-			listing_stream << "#" << hex16bit(line.operand);
+			listing << '#' << Hex16(line.operand);
 		else
-			listing_stream << "#" << hex8bit(line.operand);
+			listing << '#' << Hex8(line.operand);
 
 		if (label)
-			listing_stream << ')';
+			listing << ')';
 		break;
 	case IMMEDIATE:
 		if (line.instruction->operand_length == 2)
-			listing_stream << "#" << hex16bit(line.operand);
+			listing << '#' << Hex16(line.operand);
 		else
-			listing_stream << "#" << hex8bit(line.operand);
+			listing << '#' << Hex8(line.operand);
 		break;
 	case CHARACTER:
-		listing_stream << (char)line.operand;
+		listing << (char)line.operand;
 	}
 }
 
 /*
 Writes the start of a segment.
 */
-static void write_segment_start(Segment *segment, std::ostream &listing_stream) {
-	listing_stream << std::endl << std::endl;
-	listing_stream << "=== Start of " << segment->name << " ===";
+static void write_segment_start(Segment *segment, ListingBuffer &listing) {
+	listing << '\n' << '\n';
+	listing << "=== Start of " << segment->name << " ===";
 }
 
 /*
 Writes the end of a segment.
 */
-static void write_segment_end(Segment *segment, std::ostream &listing_stream) {
-	listing_stream << std::endl;
-	listing_stream << "=== End of " << segment->name << " ===" << std::endl;
+static void write_segment_end(Segment *segment, ListingBuffer &listing) {
+	listing << '\n';
+	listing << "=== End of " << segment->name << " ===" << '\n';
 }
 
 /*
 Writes the address column
 */
-static void write_address_column(const AssemblyLine &line, std::ostream &listing_stream) {
-	listing_stream << '$' << hex16bit(line.address) << INDENT;
+static void write_address_column(const AssemblyLine &line, ListingBuffer &listing) {
+	listing << '$' << Hex16(line.address) << INDENT;
 }
 
 /*
 Writes a jump label.
 */
-static void write_jump_label(std::string name, std::ostream &listing_stream) {
-	listing_stream << name << ":";
+static void write_jump_label(std::string name, ListingBuffer &listing) {
+	listing << name << ":";
 	if (name.length() > LABEL_LIMIT) {	//put assembly directive on the next line if label is too long
-		listing_stream << std::endl;
-		listing_stream << (add_address_column ? "     " : "") << INDENT << INDENT << INDENT;
+		listing << '\n';
+		listing << (add_address_column ? "     " : "") << INDENT << INDENT << INDENT;
 	}
 	else {
-		listing_stream << std::string(LABEL_LIMIT - name.length(), ' ');
+		for (size_t i = name.length(); i < LABEL_LIMIT; i++)
+			listing << ' ';
 	}
 }
 
 /*
 Writes a single AssemblyLine to the output stream.
 */
-static void write_code_line(const AssemblyLine &line, std::ostream &listing_stream) {
+static void write_code_line(const AssemblyLine &line, ListingBuffer &listing) {
 	//start new line
-	listing_stream << std::endl;
+	listing << '\n';
 
 	if (add_address_column)
-		write_address_column(line, listing_stream);
+		write_address_column(line, listing);
 
 	//Write label
 	Label *label = info.get_label(line.address);
 	if (label && label->jump_label) {
 		std::string name = label->get_jump_target_name(line.address);
-		write_jump_label(name, listing_stream);
+		write_jump_label(name, listing);
 	}
 	else
-		listing_stream << INDENT << INDENT;
+		listing << INDENT << INDENT;
 
 	//Write instruction mnemonic
-	listing_stream << line.instruction->mnemonic;
+	listing << line.instruction->mnemonic;
 
 	//Write operand
 	if (line.instruction->operand_length > 0) {
-		write_operand(line, listing_stream);
+		write_operand(line, listing);
 	}
 
 	//Write comment
-	if (info.has_comment())
-		listing_stream << INDENT << ";" << info.get_comment()->text;
+	if (info.has_comment(line.address))
+		listing << INDENT << ";" << info.get_comment(line.address)->text;
 
 	//Add extra newline after RET instruction
 	if (line.instruction->opcode == 0xc9)
-		listing_stream << std::endl;
+		listing << '\n';
 }
 
 /*
 Successive pseudo instructions (DATA_BYTE, DATA_WORD and TEXT) are merged to aid readibility and to preserve space. This function writes
 the first part of a pseudo instruction to the output stream.
 */
-static void start_data_instruction(const AssemblyLine &line, std::ostream &listing_stream) {
+static void start_data_instruction(const AssemblyLine &line, ListingBuffer &listing) {
 	//Create a new line
-	listing_stream << std::endl;
+	listing << '\n';
 
 	//add address collumn
 	if (add_address_column)
-		write_address_column(line, listing_stream);
+		write_address_column(line, listing);
 
 	//Write label
 	Label *label = info.get_label(line.address);
 	if (label && label->jump_label) {
 		std::string name = label->get_jump_target_name(line.address);
-		write_jump_label(name, listing_stream);
+		write_jump_label(name, listing);
 	}
 	else
-		listing_stream << INDENT << INDENT;
+		listing << INDENT << INDENT;
 
 	//Write instruction mnemonic
-	listing_stream << line.instruction->mnemonic;
+	listing << line.instruction->mnemonic;
 
 	//Write operand
 	if (line.instruction->opcode == DATA_RET)	//DATA_RET should always print an address
-		listing_stream << "$" << hex16bit(line.operand);
+		listing << '$' << Hex16(line.operand);
 	else
-		write_operand(line, listing_stream);
+		write_operand(line, listing);
 }
 
 /*
 This function writes a data instruction that is not the first data instruction of the current line.
 */
-static void continue_data_instruction(const AssemblyLine &line, std::ostream &listing_stream) {
+static void continue_data_instruction(const AssemblyLine &line, ListingBuffer &listing) {
 	if(line.instruction->opcode != DATA_TEXT)
-		listing_stream << ",";
+		listing << ',';
 
 	if(line.instruction->opcode == DATA_RET)
-		listing_stream << "$" << hex16bit(line.operand);
+		listing << '$' << Hex16(line.operand);
 	else
-		write_operand(line, listing_stream);
+		write_operand(line, listing);
 }
 
 /*
-Writes a data instruction to the output stream. Data instructions are handled differently from code instructions, in
-that successive data instructions are merged together. This function transparently takes care of that.
+Determines whether a data instruction has to start a new line, or whether it can be added to the current line.
+Returns true if a new line has to be started.
 */
-static void write_data_instruction(const AssemblyLine &line, std::ostream &listing_stream) {
-	static int prev_opcode = -1;
-
+static bool starts_data_line(const AssemblyLine &line, DataLineState &state) {
 	//Start a new line if the type of data instruction switched (e.g. from DATA_BYTE to DATA_WORD)
-	if (line.instruction->opcode != prev_opcode)
-		data_instruction_streak = 0;
+	if (line.instruction->opcode != state.prev_opcode)
+		state.data_instruction_streak = 0;
 
 	//Start a new line if the current instruction has a label pointing to it
 	if (jump_label_at(line.address))
-		data_instruction_streak = 0;
+		state.data_instruction_streak = 0;
 
 	//Start a new line if the next instruction is the start of a new segment
-	if (info.is_segment_start())
-		data_instruction_streak = 0;
+	if (info.is_segment_start(line.address))
+		state.data_instruction_streak = 0;
+
+	return state.data_instruction_streak == 0;
+}
+
+/*
+Updates the state after a data instruction has been written.
+*/
+static void end_data_instruction(const AssemblyLine &line, DataLineState &state) {
+	state.data_instruction_streak++;
+
+	//Only write a maximum of 8 data instructions on a single line, unless its text in which case we never stop
+	if (state.data_instruction_streak >= 8 && line.instruction->opcode != DATA_TEXT)
+		state.data_instruction_streak = 0;
+
+	//If the current line has a comment, the line has to end prematurely
+	if (info.has_comment(line.address))
+		state.data_instruction_streak = 0;
+
+	//End the current line if it is the last instruction of a segment
+	if (info.is_segment_end(line.address))
+		state.data_instruction_streak = 0;
+
+	state.prev_opcode = line.instruction->opcode;
+}
+
+/*
+Updates the state for a line, without writing anything. Gives the same state as write_line().
+*/
+static void skip_line(const AssemblyLine &line, DataLineState &state) {
+	if (line.instruction->instruction_type == DATA) {
+		starts_data_line(line, state);
+		end_data_instruction(line, state);
+	}
+	else
+		state.data_instruction_streak = 0;
+}
 
+/*
+Writes a data instruction to the output stream. Data instructions are handled differently from code instructions, in
+that successive data instructions are merged together. This function transparently takes care of that.
+*/
+static void write_data_instruction(const AssemblyLine &line, DataLineState &state, ListingBuffer &listing) {
 	//Start a new line or continue an existing one depending on the previous instructions
-	if (data_instruction_streak == 0) {
-		start_data_instruction(line, listing_stream);
+	if (starts_data_line(line, state)) {
+		start_data_instruction(line, listing);
 	}
 	else {
-		continue_data_instruction(line, listing_stream);
+		continue_data_instruction(line, listing);
 	}
 
-	data_instruction_streak++;
+	//If the current line has a comment, the line has to end prematurely
+	if (info.has_comment(line.address))
+		listing << INDENT << ';' << info.get_comment(line.address)->text;
 
-	//Only write a maximum of 8 data instructions on a single line, unless its text in which case we never stop
-	if (data_instruction_streak >= 8 && line.instruction->opcode != DATA_TEXT)
-		data_instruction_streak = 0;
+	end_data_instruction(line, state);
+}
 
-	//If the current line has a comment, the line has to end prematurely
-	if (info.has_comment()) {
-		listing_stream << INDENT << ";" << info.get_comment()->text;
-		data_instruction_streak = 0;
+/*
+Writes a single AssemblyLine, including the segment header and trailer.
+*/
+static void write_line(const AssemblyLine &line, DataLineState &state, ListingBuffer &listing) {
+	//Write segment header
+	if (info.is_segment_start(line.address))
+		write_segment_start(info.get_segment(line.address), listing);
+
+	if (line.instruction->instruction_type == DATA)
+		write_data_instruction(line, state, listing);
+	else {
+		write_code_line(line, listing);	//Write code
+		state.data_instruction_streak = 0;
 	}
 
-	//End the current line if it is the last instruction of a segment
-	if (info.is_segment_end())
-		data_instruction_streak = 0;
-
-	prev_opcode = line.instruction->opcode;
-}
-
-/*
-Writes the output assembly listing to the stream.
-*/
-static void write_listing(std::ostream &listing_stream) {
-	info.reset(base_address);
-	for (unsigned int i = 0; i < instructions.size(); i++) {
-		//Write segment header
-		if (info.is_segment_start())
-			write_segment_start(info.get_segment(), listing_stream);
-
-		AssemblyLine line = instructions[i];
-
-		switch(line.instruction->opcode){
-		case DATA_BYTE:		//Write data byte
-			write_data_instruction(line, listing_stream);
-			break;
-		case DATA_WORD:		//Write data word
-			write_data_instruction(line, listing_stream);
-			info.advance();
-			break;
-		case DATA_TEXT:		//Write text
-			write_data_instruction(line, listing_stream);
-			break;
-		case DATA_RET:
-			write_data_instruction(line, listing_stream);
-			info.advance();
-			break;
-		default:
-			write_code_line(line, listing_stream);	//Write code
-			for (int j = 0; j < line.instruction->operand_length; j++)
-				info.advance();
-			data_instruction_streak = 0;
+	//Write segment trailer
+	unsigned int last_address = line.address + line.length() - 1;
+	if (info.is_segment_end(last_address))
+		write_segment_end(info.get_segment(last_address), listing);
+}
+
+/*
+Returns the state of the data line merging at the first line of every chunk of LISTING_CHUNK_SIZE lines.
+*/
+static std::vector<DataLineState> chunk_start_states() {
+	std::vector<DataLineState> chunk_states((instructions.size() + LISTING_CHUNK_SIZE - 1) / LISTING_CHUNK_SIZE);
+	DataLineState state;
+	for (size_t i = 0; i < instructions.size(); i++) {
+		if (i % LISTING_CHUNK_SIZE == 0)
+			chunk_states[i / LISTING_CHUNK_SIZE] = state;
+		skip_line(instructions[i], state);
+	}
+	return chunk_states;
+}
+
+/*
+A range of AssemblyLines that is rendered as a unit, together with the state of the data line merging at its first line.
+*/
+struct ListingChunk {
+	size_t begin = 0;
+	size_t end = 0;
+	DataLineState state;
+};
+
+/*
+Splits the lines into chunks that start at multiples of CACHED_CHUNK_ADDRESSES. Unlike chunks with a fixed number of lines, these
+chunks stay the same if lines are added or removed somewhere else.
+*/
+static std::vector<ListingChunk> address_chunks() {
+	std::vector<ListingChunk> chunks;
+	DataLineState state;
+	for (size_t i = 0; i < instructions.size(); i++) {
+		if (i == 0 || instructions[i].address / CACHED_CHUNK_ADDRESSES != instructions[i - 1].address / CACHED_CHUNK_ADDRESSES) {
+			if (!chunks.empty())
+				chunks.back().end = i;
+			ListingChunk chunk;
+			chunk.begin = i;
+			chunk.state = state;
+			chunks.push_back(chunk);
 		}
+		skip_line(instructions[i], state);
+	}
+	if (!chunks.empty())
+		chunks.back().end = instructions.size();
+	return chunks;
+}
 
-		//Write segment trailer
-		if (info.is_segment_end())
-			write_segment_end(info.get_segment(), listing_stream);
+/*
+Adds everything that write_line() looks up for a line to a hash. Has to be kept in sync with the functions that write lines.
+*/
+static void hash_line(const AssemblyLine &line, Hash &hash) {
+	unsigned int last_address = line.address + line.length() - 1;
+	Label *label = info.get_label(line.address);
+	bool has_jump_label = label && label->jump_label;
+	Label *target = nullptr;
+	if (line.instruction->operand_type == ADDRESS || line.instruction->operand_type == IMMEDIATE_HYBRID)
+		target = info.get_label(line.operand);
+
+	uint64_t flags = info.is_segment_start(line.address)
+		| info.is_segment_end(line.address) << 1
+		| info.is_segment_end(last_address) << 2
+		| jump_label_at(line.address) << 3
+		| info.has_comment(line.address) << 4
+		| has_jump_label << 5
+		| (target != nullptr) << 6;
+	hash.add(line.address | (uint64_t)(line.instruction - instructions8085) << 16 | (uint64_t)(uint16_t)line.operand << 32 | flags << 48);
+
+	if (has_jump_label)
+		hash.add(label->get_jump_target_name(line.address));
+	if (target)
+		hash.add(target->get_operand_name(line.operand));
+	if (info.has_comment(line.address))
+		hash.add(info.get_comment(line.address)->text);
+	if (info.is_segment_start(line.address))
+		hash.add(info.get_segment(line.address)->name);
+	if (info.is_segment_end(last_address))
+		hash.add(info.get_segment(last_address)->name);
+}
+
+/*
+Returns the key of the rendered text of a chunk in the cache.
+*/
+static uint64_t chunk_key(const ListingChunk &chunk) {
+	Hash hash;
+	hash.add((uint64_t)add_address_column);
+	hash.add((uint64_t)chunk.state.data_instruction_streak | (uint64_t)(uint32_t)chunk.state.prev_opcode << 32);
+	for (size_t i = chunk.begin; i < chunk.end; i++)
+		hash_line(instructions[i], hash);
+	return hash.value();
+}
 
-		info.advance();
+/*
+Writes the output assembly listing. The lines are split into chunks, which are rendered into separate buffers by up to the given
+number of threads, and then written in order. The state of the data line merging at the start of each chunk is determined beforehand,
+so the result is the same as if all lines were written one after another.
+If the cache is enabled, the chunks cover CACHED_CHUNK_ADDRESSES addresses each, and only chunks whose lines, labels, segments or
+comments have changed since an earlier run are rendered. All other chunks are copied from the cache.
+*/
+static void write_listing(ListingBuffer &listing, unsigned int threads, const CacheDirectory &cache) {
+	std::vector<ListingChunk> chunks;
+	if (cache.enabled())
+		chunks = address_chunks();
+	else {
+		std::vector<DataLineState> chunk_states = chunk_start_states();
+		for (size_t c = 0; c < chunk_states.size(); c++) {
+			ListingChunk chunk;
+			chunk.begin = c * LISTING_CHUNK_SIZE;
+			chunk.end = std::min(instructions.size(), (c + 1) * LISTING_CHUNK_SIZE);
+			chunk.state = chunk_states[c];
+			chunks.push_back(chunk);
+		}
 	}
+
+	std::vector<ListingBuffer> texts(chunks.size());
+	std::atomic<size_t> next_chunk(0);
+	auto write_chunks = [&]() {
+		size_t c;
+		while ((c = next_chunk++) < chunks.size()) {
+			uint64_t key = 0;
+			if (cache.enabled()) {
+				key = chunk_key(chunks[c]);
+				RomImage entry;
+				CacheReader in;
+				if (cache.load(key, LISTING_EXTENSION, entry, in)) {
+					uint32_t length = in.read_u32();
+					const char *text = in.read_bytes(length);
+					if (text && in.at_end()) {
+						texts[c].append(text, length);
+						continue;
+					}
+				}
+			}
+
+			DataLineState chunk_state = chunks[c].state;
+			for (size_t i = chunks[c].begin; i < chunks[c].end; i++)
+				write_line(instructions[i], chunk_state, texts[c]);
+
+			if (cache.enabled()) {
+				std::string text = texts[c].contents();
+				CacheWriter out;
+				out.write_u32((uint32_t)text.length());
+				out.write_bytes(text.data(), text.length());
+				cache.store(key, LISTING_EXTENSION, out);
+			}
+		}
+	};
+
+	threads = std::max(1u, (unsigned int)std::min((size_t)threads, chunks.size()));
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threads; t++)
+		workers.push_back(std::thread(write_chunks));
+	write_chunks();
+	for (std::thread &w : workers)
+		w.join();
+
+	for (const ListingBuffer &text : texts)
+		listing.append(text);
+}
+
+/*
+Writes the output assembly listing using three stages that run at the same time: the first one splits the lines into chunks
+and determines the state at the start of each chunk, the second one renders the chunks in order and the third one writes them
+to the output stream. The stages are connected by bounded queues, so only a few rendered chunks are kept in memory at any time,
+and writing to a slow output overlaps with rendering.
+*/
+static void write_listing_pipelined(ListingBuffer &listing) {
+	BoundedQueue<ListingChunk> ranges(PIPELINE_QUEUE_SIZE);
+	BoundedQueue<std::unique_ptr<ListingBuffer>> rendered(PIPELINE_QUEUE_SIZE);
+
+	std::thread split_stage([&]() {
+		DataLineState state;
+		for (size_t begin = 0; begin < instructions.size(); begin += LISTING_CHUNK_SIZE) {
+			ListingChunk chunk;
+			chunk.begin = begin;
+			chunk.end = std::min(instructions.size(), begin + LISTING_CHUNK_SIZE);
+			chunk.state = state;
+			for (size_t i = chunk.begin; i < chunk.end; i++)
+				skip_line(instructions[i], state);
+			ranges.push(chunk);
+		}
+		ranges.close();
+	});
+
+	std::thread render_stage([&]() {
+		ListingChunk chunk;
+		while (ranges.pop(chunk)) {
+			std::unique_ptr<ListingBuffer> text(new ListingBuffer());
+			for (size_t i = chunk.begin; i < chunk.end; i++)
+				write_line(instructions[i], chunk.state, *text);
+			rendered.push(std::move(text));
+		}
+		rendered.close();
+	});
+
+	std::unique_ptr<ListingBuffer> text;
+	while (rendered.pop(text)) {
+		listing.append(*text);
+		listing.flush();
+	}
+
+	split_stage.join();
+	render_stage.join();
+}
+
+/*
+Writes the cross references as a section of comments at the end of the listing. Every address that is referenced gets one line,
+containing its label and the instructions that refer to it.
+*/
+static void write_xref_section(ListingBuffer &listing) {
+	listing << '\n' << '\n' << ";=== Cross references ===";
+	for (unsigned int target = 0; target < ADDRESS_SPACE_SIZE; target++) {
+		unsigned int count = xrefs.count(target);
+		if (count == 0)
+			continue;
+
+		listing << '\n' << ";$" << Hex16(target);
+		Label *label = info.get_label(target);
+		std::string name = label ? label->get_operand_name(target) : "";
+		if (!name.empty())
+			listing << ' ' << name;
+		listing << ':';
+
+		for (unsigned int i = 0; i < count; i++) {
+			listing << (i == 0 ? " $" : ", $") << Hex16(xrefs.source(target, i));
+			listing << ' ' << xrefs.instruction(target, i)->name();
+		}
+	}
+	listing << '\n';
+}
+
+/*
+Writes the cross references with one reference per line: the referenced address, the address of the instruction and its mnemonic.
+The lines are sorted by the referenced address.
+*/
+static void write_xref_file(ListingBuffer &out) {
+	for (unsigned int target = 0; target < ADDRESS_SPACE_SIZE; target++) {
+		for (unsigned int i = 0; i < xrefs.count(target); i++)
+			out << '$' << Hex16(target) << " $" << Hex16(xrefs.source(target, i)) << ' ' << xrefs.instruction(target, i)->name() << '\n';
+	}
+}
+
+/*
+Writes the control-flow graph in the DOT language. Every block is labelled with its address range and the label at its start.
+Jumps are drawn as solid lines, calls as dashed lines and fall-through edges as dotted lines.
+*/
+static void write_graph_dot(ListingBuffer &out) {
+	static const char *edge_styles[] = { "dotted", "solid", "dashed" };
+	const std::vector<BasicBlock> &blocks = flow_graph.get_blocks();
+
+	out << "digraph cfg {\n";
+	out << INDENT << "node [shape=box, fontname=monospace];\n";
+	for (size_t b = 0; b < blocks.size(); b++) {
+		out << INDENT << 'b' << std::to_string(b) << " [label=\"$" << Hex16(blocks[b].start_address) << "-$" << Hex16(blocks[b].end_address);
+		Label *label = info.get_label(blocks[b].start_address);
+		std::string name = label ? label->get_jump_target_name(blocks[b].start_address) : "";
+		if (!name.empty())
+			out << "\\n" << name;
+		out << "\"];\n";
+	}
+	for (size_t b = 0; b < blocks.size(); b++) {
+		for (unsigned int i = 0; i < flow_graph.successor_count((unsigned int)b); i++) {
+			const FlowEdge &e = flow_graph.successor((unsigned int)b, i);
+			out << INDENT << 'b' << std::to_string(b) << " -> b" << std::to_string(e.block) << " [style=" << edge_styles[e.kind] << "];\n";
+		}
+	}
+	out << "}\n";
+}
+
+/*
+Writes the control-flow graph with one block per line: the first and last address of the block, followed by its successors.
+Every successor is written as its start address, prefixed with f for fall-through edges, j for jumps and c for calls.
+*/
+static void write_graph_adjacency(ListingBuffer &out) {
+	static const char edge_kinds[] = { 'f', 'j', 'c' };
+	const std::vector<BasicBlock> &blocks = flow_graph.get_blocks();
+
+	for (size_t b = 0; b < blocks.size(); b++) {
+		out << '$' << Hex16(blocks[b].start_address) << " $" << Hex16(blocks[b].end_address);
+		for (unsigned int i = 0; i < flow_graph.successor_count((unsigned int)b); i++) {
+			const FlowEdge &e = flow_graph.successor((unsigned int)b, i);
+			out << ' ' << edge_kinds[e.kind] << '$' << Hex16(blocks[e.block].start_address);
+		}
+		out << '\n';
+	}
+}
+
+/*
+Writes every branch target that was found by scan_branches(), followed by the addresses of the branches that jump there.
+*/
+static void write_jump_report(ListingBuffer &report) {
+	std::vector<BranchSite> sites = scan_branches(input);
+	std::stable_sort(sites.begin(), sites.end(), [](const BranchSite &a, const BranchSite &b) { return a.target < b.target; });
+
+	for (size_t i = 0; i < sites.size(); i++) {
+		if (i == 0 || sites[i].target != sites[i - 1].target) {
+			if (i > 0)
+				report << '\n';
+			report << '$' << Hex16(sites[i].target) << INDENT;
+		}
+		else
+			report << ' ';
+		report << '$' << Hex16(sites[i].address);
+	}
+	report << '\n';
 }
 
 /*
@@ -512,28 +689,33 @@ static void write_listing(std::ostream &listing_stream) {
 Creates labels for 8085 interrupt vectors.
 */
 static void add_interrupt_labels() {
-	info.add_label("rst0", 0x00, CODE_T);
-	info.add_label("rst1", 0x08, CODE_T);
-	info.add_label("rst2", 0x10, CODE_T);
-	info.add_label("rst3", 0x18, CODE_T);
-	info.add_label("rst4", 0x20, CODE_T);
-	info.add_label("trap", 0x24, CODE_T);
-	info.add_label("rst5", 0x28, CODE_T);
-	info.add_label("rst55", 0x2c, CODE_T);
-	info.add_label("rst6", 0x30, CODE_T);
-	info.add_label("rst65", 0x34, CODE_T);
-	info.add_label("rst7", 0x38, CODE_T);
-	info.add_label("rst75", 0x3c, CODE_T);
+	for (const InterruptVector &v : interrupt_vectors)
+		info.add_label(v.name, v.address, CODE_T);
 }
 
 /*
 Copies the jummp labels from to the DSMInfo instance
 */
-static void copy_labels_to_info(std::unordered_map<unsigned int, std::string> &labels) {
+static void copy_labels_to_info(const std::unordered_map<unsigned int, std::string> &labels) {
+	DSMInfoBuilder builder;
 	for (auto label : labels) {
 		if (!info.label_at(label.first))
-			info.add_label(label.second, label.first, CODE_T);
+			builder.add_label(label.second, label.first, CODE_T);
 	}
+	builder.build(info);
+}
+
+/*
+Opens the output file, or selects stdout if the output file name is "-". Returns nullptr if the file could not be opened.
+*/
+static std::ostream *open_output(std::ofstream &file) {
+	if (output_file == "-")
+		return &std::cout;
+
+	file.open(output_file, std::ios_base::out);
+	if (!file)
+		return nullptr;
+	return &file;
 }
 
 static void print_version() {
@@ -555,6 +737,152 @@ static inline bool set_int_argument(unsigned int &arg, std::string value) {
 	}
 }
 
+/*
+Answers queries about the disassembly on stdin and stdout, until stdin is closed.
+*/
+static void serve_queries() {
+	std::vector<DataLineState> chunk_states = chunk_start_states();
+	auto render = [&](size_t first, size_t end, ListingBuffer &out) {
+		size_t chunk_start = first / LISTING_CHUNK_SIZE * LISTING_CHUNK_SIZE;
+		DataLineState state = chunk_states[first / LISTING_CHUNK_SIZE];
+		for (size_t i = chunk_start; i < first; i++)
+			skip_line(instructions[i], state);
+		for (size_t i = first; i < end; i++)
+			write_line(instructions[i], state, out);
+	};
+
+	QueryServer server(instructions, info, xrefs, render);
+	server.serve(std::cin, std::cout);
+}
+
+/*
+Loads the labels, decodes the input and writes the listing and all other requested output. If watcher is given, every label
+file is added to it right before it is read, and label files are only parsed if they are not in parsed_label_files. Can be called
+repeatedly, in which case the input is only decoded again if the labels changed in a way that affects decoding.
+*/
+static int disassemble(FileWatcher *watcher) {
+	CacheDirectory cache(cache_directory);
+	info.clear();
+
+	//add labels for interrupt vectors
+	if(hw_labels)
+		add_interrupt_labels();
+
+	//load user labels
+	if (!labels_file.empty()) {
+		try {
+			std::function<void(const std::string &)> file_read;
+			if (watcher)
+				file_read = [watcher](const std::string &name) { watcher->add(name); };
+
+			if (!Parser::parse(labels_file, info, file_read, threads, watcher ? &parsed_label_files : nullptr, cache.enabled() ? &cache : nullptr)) {
+				std::cerr << "Error: File not found: " << labels_file << std::endl;
+				return ERROR_FILE_NOT_FOUND;
+			}
+		}
+		catch (parse_error &) {
+			return ERROR_BAD_LABEL_FILE;
+		}
+	}
+
+	std::ofstream listing_file;
+	std::ostream *listing_stream = serve ? &std::cout : open_output(listing_file);
+	if (!listing_stream) {
+		std::cerr << "Error: File could net be opened: " << output_file << std::endl;
+		return ERROR_FILE_NOT_FOUND;
+	}
+
+	//All user information is known at this point, so the address table can be built
+	info.compile();
+
+	//Decoding only has to be done if neither an earlier round nor the cache already have the result
+	DecodeCache decode_cache(cache);
+	decode_cache.compute_key(input, superset ? DECODE_SUPERSET : follow_control_flow ? DECODE_REACHABLE : DECODE_ALL);
+	if (!decoded || decode_cache.get_key() != decoded_key) {
+		jump_labels = JumpLabels();
+		if (!decode_cache.load(jump_labels, instructions)) {
+			if (superset)
+				find_superset_code(input, threads);
+			else if (follow_control_flow)
+				find_reachable_code(input);
+
+			decode_input(input, jump_labels, instructions, threads);
+
+			decode_cache.store(jump_labels, instructions);
+		}
+		decoded = true;
+		decoded_key = decode_cache.get_key();
+	}
+	if (list_xrefs || serve)
+		xrefs.build(instructions);
+	if (!graph_name.empty())
+		flow_graph.build(instructions);
+
+	//Rebuild the address table, so it includes the jump labels
+	copy_labels_to_info(used_jump_labels(input, jump_labels, instructions));
+	info.compile();
+
+	//Answer queries instead of writing any output
+	if (serve) {
+		cache.evict();
+		serve_queries();
+		return NO_ERROR;
+	}
+
+	//Write final listing. Output to stdout is always pipelined, so it starts before the whole listing has been rendered.
+	ListingBuffer listing(*listing_stream);
+	if (pipelined || output_file == "-")
+		write_listing_pipelined(listing);
+	else
+		write_listing(listing, threads, cache);
+	if (list_xrefs)
+		write_xref_section(listing);
+	listing.flush();
+
+	//Write the cross references. There is no file name to derive the name from if the listing goes to stdout.
+	if (list_xrefs && output_file != "-") {
+		std::string xref_file = output_file.substr(0, output_file.rfind(".")) + ".xrf";
+		std::ofstream xref_stream(xref_file, std::ios_base::out);
+		if (!xref_stream) {
+			std::cerr << "Error: File could net be opened: " << xref_file << std::endl;
+			return ERROR_FILE_NOT_FOUND;
+		}
+		ListingBuffer xref_listing(xref_stream);
+		write_xref_file(xref_listing);
+	}
+
+	//Write the control-flow graph
+	if (!graph_name.empty()) {
+		std::ofstream dot_stream(graph_name + ".dot", std::ios_base::out);
+		std::ofstream adjacency_stream(graph_name + ".adj", std::ios_base::out);
+		if (!dot_stream || !adjacency_stream) {
+			std::cerr << "Error: File could net be opened: " << graph_name << std::endl;
+			return ERROR_FILE_NOT_FOUND;
+		}
+		ListingBuffer dot(dot_stream);
+		write_graph_dot(dot);
+		ListingBuffer adjacency(adjacency_stream);
+		write_graph_adjacency(adjacency);
+	}
+
+	//Write machine-readable output
+	if (!export_name.empty()) {
+		std::ofstream binary_stream(export_name + ".dsmb", std::ios_base::out | std::ios_base::binary);
+		std::ofstream json_stream(export_name + ".jsonl", std::ios_base::out | std::ios_base::binary);
+		if (!binary_stream || !json_stream) {
+			std::cerr << "Error: File could net be opened: " << export_name << std::endl;
+			return ERROR_FILE_NOT_FOUND;
+		}
+		write_binary_export(binary_stream, instructions, info);
+		write_json_export(json_stream, instructions, info);
+	}
+
+	//Clean up
+	listing_stream->flush();
+	cache.evict();
+	return NO_ERROR;
+}
+
 int main(int argc, char *argv[]) {
 	//Setup ArgumentParser
 	ArgumentParser parser;
@@ -566,7 +894,7 @@ int main(int argc, char *argv[]) {
 	);
 	parser.create_argument(
 		"-o", "--output",
-		"Name of the file to write the disassembly to. If no output file is given,\nthe output will be written to [input file name].lst",
+		"Name of the file to write the disassembly to. If no output file is given,\nthe output will be written to [input file name].lst. Use - to write to stdout.",
 		{"file"},
 		[](std::string *params) -> bool {output_file = params[0];  return true; }
 	);
@@ -613,6 +941,84 @@ int main(int argc, char *argv[]) {
 		[](std::string *params) -> bool {(void)params; hw_labels = true; return true; }
 	);
 
+	parser.create_argument(
+		"-j", "--jumps",
+		"Instead of a listing, write the target of every JMP and CALL instruction, followed by the addresses of\nthe instructions that jump there. Every byte is scanned as a possible opcode, so the result may contain\nbranches that are actually data. The output file defaults to the input file with the extension .jmp.",
+		{},
+		[](std::string *params) -> bool {(void)params; list_jumps = true; return true; }
+	);
+
+	parser.create_argument(
+		"-r", "--reachable",
+		"Only disassemble code that is reachable from the reset vector, the interrupt vectors, code labels\nand ret tables. All other bytes are output as data.",
+		{},
+		[](std::string *params) -> bool {(void)params; follow_control_flow = true; return true; }
+	);
+
+	parser.create_argument(
+		"-su", "--superset",
+		"Decode an instruction at every address and only disassemble a consistent selection of them. Extends the\nreachable code with branch targets whose code does not run into data or other instructions.",
+		{},
+		[](std::string *params) -> bool {(void)params; superset = true; return true; }
+	);
+
+	parser.create_argument(
+		"-x", "--export",
+		"Additionally write the disassembly in machine-readable form, as a binary file [name].dsmb and as a file\n[name].jsonl with one JSON object per line.",
+		{ "name" },
+		[](std::string *params) -> bool {export_name = params[0]; return true; }
+	);
+
+	parser.create_argument(
+		"-xr", "--xrefs",
+		"List the instructions that refer to each address in a section at the end of the listing, and in the\nfile [output file name].xrf with one reference per line.",
+		{},
+		[](std::string *params) -> bool {(void)params; list_xrefs = true; return true; }
+	);
+
+	parser.create_argument(
+		"-g", "--graph",
+		"Build the basic-block control-flow graph and write it as [name].dot for Graphviz, and as [name].adj with\none block per line, followed by its successors.",
+		{ "name" },
+		[](std::string *params) -> bool {graph_name = params[0]; return true; }
+	);
+
+	parser.create_argument(
+		"-c", "--cache",
+		"Keep parsed label files, the decoded instructions and the rendered listing in the given directory, and\nreuse them in later runs. Only label files whose contents changed are parsed again, and only the parts\nof the listing affected by changes are rendered again. The directory is created if it does not exist,\nand can be deleted at any time. Entries that were not used recently are removed once the directory\nholds more than "
+		+ std::to_string(CACHE_MAX_SIZE / (1024 * 1024)) + " MB.",
+		{ "directory" },
+		[](std::string *params) -> bool {cache_directory = params[0]; return true; }
+	);
+
+	parser.create_argument(
+		"-w", "--watch",
+		"Keep running and write the listing again whenever the label file or one of the files it includes changes.\nThe input file is only read once.",
+		{},
+		[](std::string *params) -> bool {(void)params; watch = true; return true; }
+	);
+
+	parser.create_argument(
+		"-q", "--query",
+		"Instead of writing a listing, keep the disassembly in memory and answer queries from stdin on stdout.\nEvery query and every answer is a JSON object on a single line, see QueryServer.h.",
+		{},
+		[](std::string *params) -> bool {(void)params; serve = true; return true; }
+	);
+
+	parser.create_argument(
+		"-p", "--pipeline",
+		"Write the listing while it is still being rendered, keeping only a few parts of it in memory at a time.\nUseful for large inputs or slow output files.",
+		{},
+		[](std::string *params) -> bool {(void)params; pipelined = true; return true; }
+	);
+
+	parser.create_argument(
+		"-t", "--threads",
+		"Number of threads used for parsing label files, decoding and writing the listing. Use 0 to select the number of available cores. Defaults to 1.",
+		{ "integer" },
+		[](std::string *params) -> bool { return set_int_argument(threads, params[0]); }
+	);
+
 	//Read arguments
 	bool successfully_parsed = parser.parse(argc, argv);
 
@@ -627,6 +1033,9 @@ int main(int argc, char *argv[]) {
 		return print_help ? NO_ERROR : ERROR_BAD_ARGUMENTS;
 	}
 
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
 	//Resolve dependencies between arguments.
 	//the default values of base_address and end_address depend on other arguments
 	if (base_address == MAX_ADDRESS)
@@ -634,63 +1043,89 @@ int main(int argc, char *argv[]) {
 	if (end_address == MAX_ADDRESS && input_length != MAX_ADDRESS)
 		end_address = start_address + input_length - 1;
 
-	//Create input & output streams
+	//Load input file. A file name of "-" reads the input from stdin, keeping only the bytes that get disassembled.
 	std::string input_file = parser.files[0];
-	std::ifstream rom_stream(input_file,std::ios_base::in | std::ios_base::binary);
-	if (rom_stream.fail()) {
+	bool from_stdin = input_file == "-";
+	RomImage rom;
+	if (from_stdin) {
+		size_t max_length = end_address >= start_address ? (size_t)end_address + 1 - start_address : 0;
+		max_length = std::min(max_length, base_address <= MAX_ADDRESS ? (size_t)MAX_ADDRESS + 1 - base_address : 0);
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		if (!rom.read(std::cin, start_address, max_length)) {
+			std::cerr << "Error: Could not read from stdin" << std::endl;
+			return ERROR_FILE_NOT_FOUND;
+		}
+	}
+	else if (!rom.open(input_file)) {
 		std::cerr << "Error: File not found: " << input_file << std::endl;
 		return ERROR_FILE_NOT_FOUND;
 	}
 
-	//Set output file to default if not given
+	//Restrict the input to the range given by start_address and end_address
+	size_t rom_end = rom.offset() + rom.size();
+	size_t rom_first = std::min(std::max((size_t)start_address, rom.offset()), rom_end) - rom.offset();
+	size_t rom_last = std::min(std::max((size_t)end_address + 1, rom.offset()), rom_end) - rom.offset();
+
+	//Addresses must not go past the end of the address space
+	size_t address_space_left = base_address <= MAX_ADDRESS ? MAX_ADDRESS + 1 - base_address : 0;
+	rom_last = std::min(rom_last, rom_first + address_space_left);
+	input.rom_begin = rom.data() + rom_first;
+	input.rom_end = rom.data() + std::max(rom_first, rom_last);
+	input.base_address = base_address;
+	input.info = &info;
+
+	//Set output file to default if not given. Input from stdin is written to stdout by default.
+	if (output_file.length() == 0 && from_stdin)
+		output_file = "-";
 	if (output_file.length() == 0) {
 		size_t ending = input_file.rfind(".");
 		std::string input_name = input_file.substr(0, ending);
-		output_file = input_name + ".lst";
+		output_file = input_name + (list_jumps ? ".jmp" : ".lst");
 	}
 
-	//add labels for interrupt vectors
-	if(hw_labels)
-		add_interrupt_labels();
-
-	//load user labels
-	if (!labels_file.empty()) {
-		std::ifstream labels_stream(labels_file, std::ios_base::in | std::ios_base::binary);
-		if (labels_stream.fail()) {
-			std::cerr << "Error: File not found: " << labels_file << std::endl;
+	//The jump report does not depend on labels
+	if (list_jumps) {
+		std::ofstream report_file;
+		std::ostream *report_stream = open_output(report_file);
+		if (!report_stream) {
+			std::cerr << "Error: File could net be opened: " << output_file << std::endl;
 			return ERROR_FILE_NOT_FOUND;
 		}
-
-		try {
-			Parser::parse(labels_stream, labels_file, info);
-		}
-		catch (parse_error &) {
-			return ERROR_BAD_LABEL_FILE;
-		}
-
-		labels_stream.close();
+		ListingBuffer report(*report_stream);
+		write_jump_report(report);
+		return NO_ERROR;
 	}
 
-	std::ofstream listing_stream(output_file, std::ios_base::out);
-	if (!listing_stream) {
-		std::cerr << "Error: File could net be opened: " << output_file << std::endl;
-		return ERROR_FILE_NOT_FOUND;
+	if (serve && from_stdin) {
+		std::cerr << "Error: --query reads queries from stdin, so the input can not be read from stdin" << std::endl;
+		return ERROR_BAD_ARGUMENTS;
 	}
 
-	//First pass
-	label_output = &first_pass_labels;
-	single_pass(rom_stream);
+	if (!watch)
+		return disassemble(nullptr);
 
-	//Second pass
-	label_output = &second_pass_labels;
-	single_pass(rom_stream);
+	//Watch mode: the input stays loaded, and the listing is written again whenever one of the label files changes
+	if (labels_file.empty()) {
+		std::cerr << "Error: --watch requires a label file" << std::endl;
+		return ERROR_BAD_ARGUMENTS;
+	}
 
-	copy_labels_to_info(second_pass_labels);
+	FileWatcher watcher;
+	while (true) {
+		auto start = std::chrono::steady_clock::now();
+		int result = disassemble(&watcher);
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
 
-	//Write final listing
-	write_listing(listing_stream);
+		if (result == NO_ERROR)
+			std::cerr << "Listing written to " << output_file << " in " << duration.count() << " ms" << std::endl;
+		std::cerr << "Waiting for changes to " << labels_file << "..." << std::endl;
 
-	//Clean up
-	rom_stream.close();
-	listing_stream.close();
+		watcher.wait();
+
+		//Only the changed files and the files that include them are parsed again. Unchanged files stay watched with the state
+		//they had when they were read.
+		Parser::forget_files(parsed_label_files, watcher.take_changed_files());
+	}
 }
@@ -1,92 +1,157 @@
 #include "Lexer.h"
+#include <cstdint>
+#include <cstring>
 #include <string>
 
+std::string Token::text() const {
+	if (lexem)
+		return std::string(lexem, length);
+	return copy;
+}
+
 std::string Token::to_string() {
 	std::string str = "<";
 	str += std::to_string(token_type);
 	str += ", ";
-	str += lexem;
+	str += text();
 	str += ">";
 	return str;
 }
 
-Lexer::Lexer(std::istream &in, size_t initial_capacity) : in(in), capacity(initial_capacity) {
-	lexem_buffer = new char[initial_capacity];
+Lexer::Lexer(const char *begin, const char *end) : begin(begin), end(end) {
 	reset();
 }
 
-Lexer::~Lexer() {
-	delete[] lexem_buffer;
+/*
+Moves to the next character. The end of the input is represented by the character -1.
+*/
+inline void Lexer::advance() {
+	pos++;
+	peek = pos < end ? *pos : (char)-1;
+}
+
+//Character classes
+#define C_WHITESPACE 0x01
+#define C_IDENTIFIER_START 0x02
+#define C_IDENTIFIER_BODY 0x04
+#define C_LITERAL_START 0x08
+#define C_LITERAL_BODY 0x10
+
+static constexpr uint8_t character_class(int c) {
+	return (c == ' ' || c == '\t' || c == '\r' ? C_WHITESPACE : 0)
+		| ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ? C_IDENTIFIER_START | C_IDENTIFIER_BODY : 0)
+		| (c >= '0' && c <= '9' ? C_IDENTIFIER_BODY | C_LITERAL_START | C_LITERAL_BODY : 0)
+		| (c == '$' || c == '&' || c == '@' || c == '%' ? C_LITERAL_START : 0)
+		| ((c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') ? C_LITERAL_BODY : 0)
+		| (c == 'h' || c == 'H' || c == 'o' || c == 'O' || c == 'q' || c == 'Q' || c == 'x' || c == 'X' ? C_LITERAL_BODY : 0);
 }
 
-void Lexer::increase_capacity(size_t new_capacity) {
-	if (new_capacity <= capacity)
-		return;
+#define CLASSES_4(c) character_class(c), character_class(c + 1), character_class(c + 2), character_class(c + 3)
+#define CLASSES_16(c) CLASSES_4(c), CLASSES_4(c + 4), CLASSES_4(c + 8), CLASSES_4(c + 12)
+#define CLASSES_64(c) CLASSES_16(c), CLASSES_16(c + 16), CLASSES_16(c + 32), CLASSES_16(c + 48)
 
-	char *new_buffer = new char[new_capacity];
-	for (unsigned int i = 0; i < lexem_length; i++) {
-		new_buffer[i] = lexem_buffer[i];
-	}
-	delete[] lexem_buffer;
-	lexem_buffer = new_buffer;
+//Classes of all characters, indexed by the character as an unsigned char. The end of the input (-1) has no class.
+static constexpr uint8_t character_classes[256] = { CLASSES_64(0), CLASSES_64(64), CLASSES_64(128), CLASSES_64(192) };
+
+static inline bool has_class(char c, uint8_t cls) {
+	return (character_classes[(unsigned char)c] & cls) != 0;
 }
 
 static bool is_whitespace(char c) {
-	switch (c) {
-	case ' ':
-	case '\t':
-	case '\r':
-		return true;
-	}
-	return false;
+	return has_class(c, C_WHITESPACE);
 }
 
 static bool is_valid_identifier_start(char c) {
-	if (c >= 'a' && c <= 'z')
-		return true;
-	if (c >= 'A' && c <= 'Z')
-		return true;
-	if (c == '_')
-		return true;
-	return false;
+	return has_class(c, C_IDENTIFIER_START);
 }
 
 static bool is_valid_identifier_body(char c) {
-	if (c >= '0' && c <= '9')
-		return true;
-	return is_valid_identifier_start(c);
+	return has_class(c, C_IDENTIFIER_BODY);
 }
 
 static bool is_valid_literal_start(char c) {
-	switch (c) {
-	case '$':
-	case '&':
-	case '@':
-	case '%':
-		return true;
-	}
-	return c >= '0' && c <= '9';
+	return has_class(c, C_LITERAL_START);
 }
 
 static bool is_valid_literal_body(char c) {
-	switch (c) {
-	case 'h':
-	case 'H':
-	case 'd':
-	case 'D':
-	case 'o':
-	case 'O':
-	case 'q':
-	case 'Q':
-	case 'b':
-	case 'B':
-	case 'x':
-	case 'X':
-		return true;
-	}
-	return (c >= '0' && c <= '9')
-		|| (c >= 'a' && c <= 'f')
-		|| (c >= 'A' && c <= 'F');
+	return has_class(c, C_LITERAL_BODY);
+}
+
+/*
+A reserved word. Section headers include the colon at their end, which is not part of the identifier.
+*/
+struct Keyword {
+	const char *name;	//Without the colon
+	size_t length;
+	int token_type;
+	bool colon;
+};
+
+#define KEYWORD_SLOTS 32
+#define MIN_KEYWORD_LENGTH 3
+#define MAX_KEYWORD_LENGTH 9
+
+/*
+Perfect hash of the reserved words. Words must have at least two characters.
+*/
+static constexpr unsigned int keyword_hash(const char *word, size_t length) {
+	return (unsigned int)(length + (unsigned char)word[0] + 10 * (unsigned char)word[length - 2]) % KEYWORD_SLOTS;
+}
+
+//Reserved words, each located at the slot given by keyword_hash
+static constexpr Keyword keywords[KEYWORD_SLOTS] = {
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "dwords_be", 9, DWORDS_BE, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "segments", 8, SEGMENTS, true },
+	{ "words", 5, WORDS, false },
+	{ "dwords_le", 9, DWORDS_LE, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "ret", 3, RET, false },
+	{ "text", 4, TEXT, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "labels", 6, LABELS, true },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "code", 4, CODE, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "dwords", 6, DWORDS, false },
+	{ "comments", 8, COMMENTS, true },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ "include", 7, INCLUDE, true },
+	{ "bytes", 5, BYTES, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false },
+	{ nullptr, 0, IDENTIFIER, false }
+};
+
+static constexpr bool keywords_in_place(unsigned int slot = 0) {
+	return slot == KEYWORD_SLOTS
+		|| ((keywords[slot].name == nullptr || keyword_hash(keywords[slot].name, keywords[slot].length) == slot) && keywords_in_place(slot + 1));
+}
+
+static_assert(keywords_in_place(), "Every keyword has to be located at the slot given by keyword_hash.");
+
+/*
+Returns the reserved word with the given spelling, or nullptr if the word is an ordinary identifier.
+*/
+static const Keyword *find_keyword(const char *word, size_t length) {
+	if (length < MIN_KEYWORD_LENGTH || length > MAX_KEYWORD_LENGTH)
+		return nullptr;
+
+	const Keyword *keyword = &keywords[keyword_hash(word, length)];
+	if (keyword->name && keyword->length == length && std::memcmp(keyword->name, word, length) == 0)
+		return keyword;
+	return nullptr;
 }
 
 enum states {
@@ -109,40 +174,12 @@ enum states {
 	S_MULTIPLY,
 	S_DIVIDE,
 	S_MODULO,
-	S_EOI,
-
-	S_BYTES,
-	S_CODE,
-	S_COMMENTS,
-	S_DWORDS,
-	S_DWORDS_BE,
-	S_DWORDS_LE,
-	S_TEXT,
-	S_RET,
-	S_INCLUDE,
-	S_LABELS,
-	S_SEGMENTS,
-	S_WORDS,
-
-	//Keep this the last value:
-	NUM_STATES
+	S_EOI
 };
 
-#define MATCH(c) \
-	if(peek==c) \
-		state+=NUM_STATES; \
-	else if(is_whitespace(peek)) \
-		return IDENTIFIER; \
-	else { \
-		state=S_IDENTIFIER; \
-		return PUSH; \
-	}
-
-//Defines a state where the corresponding reserved word has been matched up to and including the b-th character
-#define MATCHED_UP_TO(a,b) a+b*NUM_STATES
-
 #define PUSH -1
 #define SKIP -2
+#define SKIP_LAST -3	//Skips a character that ends the lexem, like the closing quote of a string
 
 int Lexer::process_character() {
 	switch (state) {
@@ -169,16 +206,7 @@ int Lexer::process_character() {
 		case ']': state = S_RIGHT_BRACKET; return PUSH;
 		case '.': state = S_RANGE; return PUSH;
 		case '\"': state = S_STRING; return SKIP;
-		case 'b': state = MATCHED_UP_TO(S_BYTES, 0); return PUSH;
-		case 'c': state = MATCHED_UP_TO(S_CODE, 0); return PUSH;
-		case 'd': state = MATCHED_UP_TO(S_DWORDS, 0); return PUSH;
-		case 'i': state = MATCHED_UP_TO(S_INCLUDE, 0); return PUSH;
-		case 'l': state = MATCHED_UP_TO(S_LABELS, 0); return PUSH;
-		case 'r': state = MATCHED_UP_TO(S_RET, 0); return PUSH;
-		case 's': state = MATCHED_UP_TO(S_SEGMENTS, 0); return PUSH;
-		case 't': state = MATCHED_UP_TO(S_TEXT, 0); return PUSH;
-		case 'w': state = MATCHED_UP_TO(S_WORDS, 0); return PUSH;
-		case '#': state = MATCHED_UP_TO(S_COMMENT, 0); return SKIP;
+		case '#': state = S_COMMENT; return SKIP;
 		case -1: state = S_EOI; return PUSH;
 		}
 		return PUSH;
@@ -188,11 +216,6 @@ int Lexer::process_character() {
 			return PUSH;
 		}else
 			return SKIP;
-	case S_IDENTIFIER:
-		if (!is_valid_identifier_body(peek))
-			return IDENTIFIER;
-		else
-			return PUSH;
 	case S_LITERAL:
 		//Literals are checked in the parser, not in the lexer
 		if (is_valid_literal_body(peek))
@@ -206,7 +229,7 @@ int Lexer::process_character() {
 		}
 		else if (peek == '\"') {
 			state = S_STRING_COMPLETE;
-			return SKIP;
+			return SKIP_LAST;
 		}
 		else
 			return PUSH;
@@ -240,169 +263,108 @@ int Lexer::process_character() {
 	case S_LEFT_BRACKET: return LEFT_BRACKET;
 	case S_RIGHT_BRACKET: return RIGHT_BRACKET;
 	case S_EOI: return EOI;
+	}
 
-	case MATCHED_UP_TO(S_BYTES, 0): MATCH('y')
-	case MATCHED_UP_TO(S_BYTES, 1): MATCH('t')
-	case MATCHED_UP_TO(S_BYTES, 2): MATCH('e')
-	case MATCHED_UP_TO(S_BYTES, 3): MATCH('s')
-	case MATCHED_UP_TO(S_BYTES, 4):
-		if (is_whitespace(peek))
-			return BYTES;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
-
-	case MATCHED_UP_TO(S_CODE, 0): MATCH('o')
-	case MATCHED_UP_TO(S_CODE, 1):
-		if (peek == 'd')
-			state++;
-		else if (peek == 'm')
-			state = MATCHED_UP_TO(S_COMMENTS, 2);
-		else
-			state = S_IDENTIFIER;
-		return PUSH;
-	case MATCHED_UP_TO(S_CODE, 2): MATCH('e')
-	case MATCHED_UP_TO(S_CODE, 3):
-		if(is_whitespace(peek))
-			return CODE;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
+	//Error
+	state = S_START;
+	return PUSH;
+}
 
-	case MATCHED_UP_TO(S_COMMENTS, 2): MATCH('m')
-	case MATCHED_UP_TO(S_COMMENTS, 3): MATCH('e')
-	case MATCHED_UP_TO(S_COMMENTS, 4): MATCH('n')
-	case MATCHED_UP_TO(S_COMMENTS, 5): MATCH('t')
-	case MATCHED_UP_TO(S_COMMENTS, 6): MATCH('s')
-	case MATCHED_UP_TO(S_COMMENTS, 7): MATCH(':')
-	case MATCHED_UP_TO(S_COMMENTS, 8): return COMMENTS;
-
-	case MATCHED_UP_TO(S_DWORDS, 0): MATCH('w')
-	case MATCHED_UP_TO(S_DWORDS, 1): MATCH('o')
-	case MATCHED_UP_TO(S_DWORDS, 2): MATCH('r')
-	case MATCHED_UP_TO(S_DWORDS, 3): MATCH('d')
-	case MATCHED_UP_TO(S_DWORDS, 4): MATCH('s')
-	case MATCHED_UP_TO(S_DWORDS, 5):
-		if (peek == '_') {
-			state = MATCHED_UP_TO(S_DWORDS_BE, 6);
-			return PUSH;
+/*
+Skips whitespace and comments in bulk, up to the next character that can start a token. The newline at the end of a comment
+is not skipped, since it is a token of its own.
+*/
+void Lexer::skip_blanks() {
+	while (pos < end) {
+		char c = *pos;
+		if (is_whitespace(c))
+			pos++;
+		else if (c == '#') {
+			const char *newline = (const char *)std::memchr(pos, '\n', end - pos);
+			pos = newline ? newline : end;
 		}
-		else if(is_whitespace(peek))
-			return DWORDS;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
-	case MATCHED_UP_TO(S_DWORDS_BE, 6):
-		if (peek == 'b')
-			state = MATCHED_UP_TO(S_DWORDS_BE, 7);
-		else if (peek == 'l')
-			state = MATCHED_UP_TO(S_DWORDS_LE, 7);
-		else if (is_whitespace(peek))
-			return IDENTIFIER;
 		else
-			state = S_IDENTIFIER;
-		return PUSH;
-	case MATCHED_UP_TO(S_DWORDS_BE, 7): MATCH('e')
-	case MATCHED_UP_TO(S_DWORDS_BE, 8):
-		if (is_whitespace(peek))
-			return DWORDS_BE;
-		else{
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
-	case MATCHED_UP_TO(S_DWORDS_LE, 7): MATCH('e')
-	case MATCHED_UP_TO(S_DWORDS_LE, 8):
-		if (is_whitespace(peek))
-			return DWORDS_LE;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
-
-	case MATCHED_UP_TO(S_INCLUDE, 0): MATCH('n')
-	case MATCHED_UP_TO(S_INCLUDE, 1): MATCH('c')
-	case MATCHED_UP_TO(S_INCLUDE, 2): MATCH('l')
-	case MATCHED_UP_TO(S_INCLUDE, 3): MATCH('u')
-	case MATCHED_UP_TO(S_INCLUDE, 4): MATCH('d')
-	case MATCHED_UP_TO(S_INCLUDE, 5): MATCH('e')
-	case MATCHED_UP_TO(S_INCLUDE, 6): MATCH(':')
-	case MATCHED_UP_TO(S_INCLUDE, 7): return INCLUDE;
-
-	case MATCHED_UP_TO(S_LABELS, 0): MATCH('a')
-	case MATCHED_UP_TO(S_LABELS, 1): MATCH('b')
-	case MATCHED_UP_TO(S_LABELS, 2): MATCH('e')
-	case MATCHED_UP_TO(S_LABELS, 3): MATCH('l')
-	case MATCHED_UP_TO(S_LABELS, 4): MATCH('s')
-	case MATCHED_UP_TO(S_LABELS, 5): MATCH(':')
-	case MATCHED_UP_TO(S_LABELS, 6): return LABELS;
-
-	case MATCHED_UP_TO(S_RET, 0): MATCH('e')
-	case MATCHED_UP_TO(S_RET, 1): MATCH('t')
-	case MATCHED_UP_TO(S_RET, 2):
-		if (is_whitespace(peek))
-			return RET;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
-
-	case MATCHED_UP_TO(S_SEGMENTS, 0): MATCH('e')
-	case MATCHED_UP_TO(S_SEGMENTS, 1): MATCH('g')
-	case MATCHED_UP_TO(S_SEGMENTS, 2): MATCH('m')
-	case MATCHED_UP_TO(S_SEGMENTS, 3): MATCH('e')
-	case MATCHED_UP_TO(S_SEGMENTS, 4): MATCH('n')
-	case MATCHED_UP_TO(S_SEGMENTS, 5): MATCH('t')
-	case MATCHED_UP_TO(S_SEGMENTS, 6): MATCH('s')
-	case MATCHED_UP_TO(S_SEGMENTS, 7): MATCH(':')
-	case MATCHED_UP_TO(S_SEGMENTS, 8): return SEGMENTS;
-
-	case MATCHED_UP_TO(S_TEXT, 0): MATCH('e')
-	case MATCHED_UP_TO(S_TEXT, 1): MATCH('x')
-	case MATCHED_UP_TO(S_TEXT, 2): MATCH('t')
-	case MATCHED_UP_TO(S_TEXT, 3):
-		if (is_whitespace(peek))
-			return TEXT;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
+			break;
+	}
+	peek = pos < end ? *pos : (char)-1;
+}
 
-	case MATCHED_UP_TO(S_WORDS, 0): MATCH('o')
-	case MATCHED_UP_TO(S_WORDS, 1): MATCH('r')
-	case MATCHED_UP_TO(S_WORDS, 2): MATCH('d')
-	case MATCHED_UP_TO(S_WORDS, 3): MATCH('s')
-	case MATCHED_UP_TO(S_WORDS, 4):
-		if(is_whitespace(peek))
-			return WORDS;
-		else {
-			state = S_IDENTIFIER;
-			return PUSH;
-		}
+/*
+Reads a whole identifier starting at the current position and checks whether it is a reserved word. Reserved words that end with
+a colon only match if the colon follows directly.
+*/
+int Lexer::scan_identifier() {
+	const char *start = pos;
+	while (pos < end && is_valid_identifier_body(*pos))
+		pos++;
+
+	int token_type = IDENTIFIER;
+	const Keyword *keyword = find_keyword(start, pos - start);
+	if (keyword && !keyword->colon)
+		token_type = keyword->token_type;
+	else if (keyword && pos < end && *pos == ':') {
+		pos++;
+		token_type = keyword->token_type;
 	}
 
-	//Error
-	state = S_START;
-	return PUSH;
+	peek = pos < end ? *pos : (char)-1;
+	return token_type;
 }
 
 Token Lexer::next_token() {
 	state = S_START;
-	lexem_length = 0;
+	skip_blanks();
+
+	//Usually the characters of a lexem are contiguous in the buffer. If characters inside a lexem are skipped, e.g. the backslash
+	//of an escape sequence, the lexem is copied instead.
+	const char *lexem_start = nullptr;
+	const char *lexem_end = nullptr;
+	bool contiguous = true;
+	std::string copy;
 
 	int token_type = process_character();
 	while (true) {
 		if (token_type == PUSH) {
-			lexem_buffer[lexem_length++] = peek;
-			if (lexem_length >= capacity)
-				increase_capacity(capacity + 128);
-			peek = (char)in.get();
+			if (pos >= end) {
+				//The end of the input is processed like a character, except in strings, which would never end
+				if (state == S_STRING || state == S_STRING_MASK) {
+					token_type = ERROR;
+					break;
+				}
+				if (!lexem_start)
+					lexem_start = lexem_end = pos;
+				token_type = process_character();
+				continue;
+			}
+			if (state == S_IDENTIFIER) {
+				//Identifiers are read at once
+				const char *identifier_start = pos;
+				token_type = scan_identifier();
+				if (!lexem_start)
+					lexem_start = identifier_start;
+				if (!contiguous)
+					copy.append(identifier_start, pos);
+				lexem_end = pos;
+				break;
+			}
+			if (!lexem_start)
+				lexem_start = pos;
+			if (!contiguous)
+				copy += peek;
+			advance();
+			lexem_end = pos;
 			token_type = process_character();
 		}
-		else if (token_type == SKIP) {
-			peek = (char)in.get();
+		else if (token_type == SKIP || token_type == SKIP_LAST) {
+			if (pos >= end) {
+				token_type = ERROR;
+				break;
+			}
+			if (token_type == SKIP && lexem_start && contiguous) {
+				copy.assign(lexem_start, lexem_end - lexem_start);
+				contiguous = false;
+			}
+			advance();
 			token_type = process_character();
 		}
 		else {
@@ -411,7 +373,10 @@ Token Lexer::next_token() {
 			break;
 		}
 	}
-	return Token(token_type, std::string(lexem_buffer, lexem_length));
+
+	if (!contiguous)
+		return Token(token_type, copy);
+	return Token(token_type, lexem_start, lexem_start ? lexem_end - lexem_start : 0);
 }
 
 int Lexer::get_line_number() {
@@ -420,7 +385,6 @@ int Lexer::get_line_number() {
 
 void Lexer::reset() {
 	line = 1;
-	in.clear();
-	in.seekg(0);
-	peek = (char)in.get();
+	pos = begin;
+	peek = pos < end ? *pos : (char)-1;
 }
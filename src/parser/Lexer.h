@@ -1,7 +1,8 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <istream>
+#include <cstddef>
+#include <string>
 
 enum TokenType {
 	EOI, ERROR,
@@ -13,30 +14,55 @@ enum TokenType {
 	MULTIPLY, DIVIDE, MODULO
 };
 
+/*
+A token of a label file. Usually the lexem is not copied, but points into the buffer of the Lexer that created the token.
+Only lexems that are not contiguous in the buffer, like strings with escape sequences, are copied.
+*/
 struct Token {
 	int token_type;
-	std::string lexem;
+	const char *lexem;
+	size_t length;
+	std::string copy;	//Used if lexem is nullptr
+
+	Token(int token_type, const char *lexem = nullptr, size_t length = 0) :
+		token_type(token_type),
+		lexem(lexem),
+		length(length) {}
+
+	Token(int token_type, std::string copy) :
+		token_type(token_type),
+		lexem(nullptr),
+		length(copy.length()),
+		copy(copy) {}
+
+	/*
+	Returns the text of the token.
+	*/
+	std::string text() const;
 
-	Token(int token_type, std::string lexem) : token_type(token_type), lexem(lexem) {}
 	std::string to_string();
 };
 
+/*
+Splits the contents of a label file into tokens. The Lexer works directly on a buffer holding the whole file, which has to stay
+valid as long as the Lexer and its tokens are used.
+*/
 class Lexer {
 
-	std::istream &in;
+	const char *begin;
+	const char *end;
+	const char *pos;
 	int line;
 	int state;
 	char peek;
-	char *lexem_buffer;
-	size_t lexem_length;
-	size_t capacity;
 
-	void increase_capacity(size_t new_capacity);
+	void advance();
+	void skip_blanks();
+	int scan_identifier();
 
 	int process_character();
 public:
-	Lexer(std::istream &in, size_t initial_capacity=128);
-	~Lexer();
+	Lexer(const char *begin, const char *end);
 
 	struct Token next_token();
 
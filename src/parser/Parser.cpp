@@ -1,23 +1,72 @@
 #include "Parser.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
-#include <fstream>
 #include <string>
+#include <thread>
 #include "../util.h"
 
+//Extension of the entries in the CacheDirectory
+#define PARSED_FILE_EXTENSION ".dsml"
+
+/*
+Returns the hash of the contents of a label file.
+*/
+static uint64_t hash_contents(const char *begin, const char *end) {
+	Hash hash;
+	hash.add(begin, end - begin);
+	return hash.value();
+}
+
 int SymbolTable::get_symbol_value(std::string symbol) {
-	if (symbols.find(symbol) != symbols.end())
-		return symbols[symbol];
+	int value;
+	auto it = symbols.find(symbol);
+	if (it != symbols.end())
+		value = it->second;
+	else if (inherited_symbols && inherited_symbols->find(symbol) != inherited_symbols->end())
+		value = inherited_symbols->at(symbol);
 	else
 		throw std::invalid_argument("Cannot find symbol: " + symbol);
+
+	for (ParsedFile *recording : recordings) {
+		if (recording->known_symbols.insert(symbol).second)
+			recording->external_symbols.push_back(std::pair<std::string, int>(symbol, value));
+	}
+	return value;
 }
 
 void SymbolTable::add_symbol(std::string symbol, int value) {
 	symbols[symbol] = value;
+	for (ParsedFile *recording : recordings)
+		recording->known_symbols.insert(symbol);
+}
+
+/*
+Opens a label file, after reporting it to file_read. Returns false if the file could not be opened.
+*/
+bool SymbolTable::open_source_file(RomImage &file, const std::string &source) const {
+	if (file_read)
+		file_read(source);
+	return file.open(source);
+}
+
+Parser::Parser(const char *begin, const char *end, std::string source, SymbolTable &symbol_table, DSMInfoBuilder &info) :
+	source(source),
+	info(info),
+	lexer(Lexer(begin, end)),
+	symbol_table(symbol_table)
+{
+	if (symbol_table.cache)
+		content_hash = hash_contents(begin, end);
+	peek = lexer.next_token();
 }
 
 void Parser::error(std::string error_message) {
-	std::cerr << "Error in file " << source << ", at line " << lexer.get_line_number() << ":" << std::endl;
-	std::cerr << "\t" << error_message << std::endl;
+	if (symbol_table.report_errors) {
+		std::cerr << "Error in file " << source << ", at line " << lexer.get_line_number() << ":" << std::endl;
+		std::cerr << "\t" << error_message << std::endl;
+	}
 	//TODO print line in question and column indicator
 	throw parse_error();
 }
@@ -31,7 +80,7 @@ Token Parser::match(int token_type, std::string error_message) {
 	else {
 		error(error_message);
 	}
-	return Token(EOI, "");
+	return Token(EOI);
 }
 
 void Parser::match_newline() {
@@ -55,7 +104,7 @@ void Parser::skip_blank_lines() {
 }
 
 void Parser::file() {
-	symbol_table.enter_source_file(source);
+	symbol_table.enter_source_file(source, content_hash);
 
 	skip_blank_lines();
 	while (peek.token_type != EOI) {
@@ -87,21 +136,282 @@ void Parser::section() {
 }
 
 void Parser::include_section() {
+	if (symbol_table.threads > 1)
+		parse_includes_in_parallel();
+
 	while (peek.token_type == STRING) {
-		std::string filename = match(STRING).lexem;
+		std::string filename = match(STRING).text();
 		if (symbol_table.is_source_file_loaded(filename))
 			error("Recursive file inclusion: " + filename);
 		else {
-			std::ifstream in(filename, std::ios_base::in | std::ios_base::binary);
-			Parser sub_parser(in, filename, symbol_table, info);
-			sub_parser.file();
-			in.close();
+			auto cached = symbol_table.parsed_files.find(filename);
+			bool in_memory = cached != symbol_table.parsed_files.end();
+			if (!in_memory || !reuse_parsed_file(cached->second)) {
+				//Files that can not be opened are treated as empty
+				RomImage file;
+				symbol_table.open_source_file(file, filename);
+				if (in_memory || !reuse_stored_file(file, filename))
+					parse_file(file, filename);
+			}
 		}
 		match_newline();
 		skip_blank_lines();
 	}
 }
 
+/*
+Parses an opened label file with a new Parser, and records its contents in the parsed files.
+*/
+void Parser::parse_file(const RomImage &file, const std::string &filename) {
+	ParsedFile parsed;
+	symbol_table.recordings.push_back(&parsed);
+
+	Parser sub_parser((const char *)file.data(), (const char *)file.data() + file.size(), filename, symbol_table, info);
+	sub_parser.file();
+
+	symbol_table.recordings.pop_back();
+	parsed.known_symbols.clear();
+	store_parsed_file(filename, parsed);
+	symbol_table.parsed_files[filename] = std::move(parsed);
+}
+
+/*
+Adds an entry to info and defines its symbol, and records the entry for all included files that are being parsed.
+*/
+void Parser::add_entry(const LabelFileEntry &entry) {
+	switch (entry.kind) {
+	case SEGMENT_ENTRY:
+		info.add_segment(entry.text, entry.type, entry.start_address, entry.end_address);
+		symbol_table.add_symbol(entry.text, entry.start_address);
+		break;
+	case LABEL_ENTRY:
+		info.add_label(entry.text, entry.start_address, entry.type);
+		symbol_table.add_symbol(entry.text, entry.start_address);
+		break;
+	case RANGE_LABEL_ENTRY:
+		info.add_range_label(entry.text, entry.start_address, entry.end_address, entry.type);
+		symbol_table.add_symbol(entry.text, entry.start_address);
+		break;
+	case COMMENT_ENTRY:
+		info.add_comment(entry.text, entry.start_address);
+		break;
+	}
+
+	for (ParsedFile *recording : symbol_table.recordings)
+		recording->entries.push_back(entry);
+}
+
+/*
+Adds the contents of an included file that has already been parsed. Returns false if the file has to be parsed again, because one
+of its files is being parsed right now, which is an error, or because a symbol it used from other files has changed.
+*/
+bool Parser::reuse_parsed_file(const ParsedFile &parsed) {
+	for (const std::string &file : parsed.files) {
+		if (symbol_table.is_source_file_loaded(file))
+			return false;
+	}
+	for (const std::pair<std::string, int> &symbol : parsed.external_symbols) {
+		try {
+			if (symbol_table.get_symbol_value(symbol.first) != symbol.second)
+				return false;
+		}
+		catch (std::invalid_argument &) {
+			return false;
+		}
+	}
+
+	for (size_t i = 0; i < parsed.files.size(); i++) {
+		if (symbol_table.file_read)
+			symbol_table.file_read(parsed.files[i]);
+		symbol_table.enter_source_file(parsed.files[i], parsed.hashes[i]);
+		symbol_table.leave_source_file();
+	}
+	for (const LabelFileEntry &entry : parsed.entries)
+		add_entry(entry);
+	return true;
+}
+
+/*
+Loads the parsed contents of an opened label file from the cache. Returns false if the cache has no entry for the file, or if one
+of the files it includes has changed since the entry was stored.
+*/
+bool Parser::load_stored_file(const RomImage &file, const std::string &filename, ParsedFile &parsed) {
+	if (!symbol_table.cache)
+		return false;
+
+	uint64_t hash = hash_contents((const char *)file.data(), (const char *)file.data() + file.size());
+	Hash key;
+	key.add(filename);
+	key.add(hash);
+
+	RomImage entry;
+	CacheReader in;
+	if (!symbol_table.cache->load(key.value(), PARSED_FILE_EXTENSION, entry, in))
+		return false;
+
+	uint32_t num_files = in.read_u32();
+	for (uint32_t i = 0; i < num_files && in.good(); i++) {
+		parsed.files.push_back(in.read_string());
+		parsed.hashes.push_back(in.read_u64());
+	}
+	uint32_t num_entries = in.read_u32();
+	for (uint32_t i = 0; i < num_entries && in.good(); i++) {
+		entry_kind kind = (entry_kind)in.read_u8();
+		data_type type = (data_type)in.read_u8();
+		unsigned int start_address = in.read_u32();
+		unsigned int end_address = in.read_u32();
+		parsed.entries.push_back(LabelFileEntry(kind, in.read_string(), type, start_address, end_address));
+	}
+	uint32_t num_symbols = in.read_u32();
+	for (uint32_t i = 0; i < num_symbols && in.good(); i++) {
+		std::string symbol = in.read_string();
+		parsed.external_symbols.push_back(std::pair<std::string, int>(symbol, (int)in.read_u32()));
+	}
+	if (!in.good() || !in.at_end() || parsed.files.empty() || parsed.files[0] != filename || parsed.hashes[0] != hash)
+		return false;
+
+	//The included files are read to compare their contents. Files that can not be opened count as empty, like when they are parsed.
+	for (size_t i = 1; i < parsed.files.size(); i++) {
+		RomImage included;
+		symbol_table.open_source_file(included, parsed.files[i]);
+		if (hash_contents((const char *)included.data(), (const char *)included.data() + included.size()) != parsed.hashes[i])
+			return false;
+	}
+	return true;
+}
+
+/*
+Adds the contents of an opened label file from the cache, and adds them to the parsed files. Returns false if the file has to be
+parsed.
+*/
+bool Parser::reuse_stored_file(const RomImage &file, const std::string &filename) {
+	ParsedFile parsed;
+	if (!load_stored_file(file, filename, parsed) || !reuse_parsed_file(parsed))
+		return false;
+	symbol_table.parsed_files[filename] = std::move(parsed);
+	return true;
+}
+
+/*
+Stores a parsed file in the cache, if there is one.
+*/
+void Parser::store_parsed_file(const std::string &filename, const ParsedFile &parsed) {
+	if (!symbol_table.cache)
+		return;
+
+	CacheWriter out;
+	out.write_u32((uint32_t)parsed.files.size());
+	for (size_t i = 0; i < parsed.files.size(); i++) {
+		out.write_string(parsed.files[i]);
+		out.write_u64(parsed.hashes[i]);
+	}
+	out.write_u32((uint32_t)parsed.entries.size());
+	for (const LabelFileEntry &entry : parsed.entries) {
+		out.write_u8((uint8_t)entry.kind);
+		out.write_u8((uint8_t)entry.type);
+		out.write_u32(entry.start_address);
+		out.write_u32(entry.end_address);
+		out.write_string(entry.text);
+	}
+	out.write_u32((uint32_t)parsed.external_symbols.size());
+	for (const std::pair<std::string, int> &symbol : parsed.external_symbols) {
+		out.write_string(symbol.first);
+		out.write_u32((uint32_t)symbol.second);
+	}
+
+	Hash key;
+	key.add(filename);
+	key.add(parsed.hashes[0]);
+	symbol_table.cache->store(key.value(), PARSED_FILE_EXTENSION, out);
+}
+
+/*
+Returns the names of the files in the include section that starts at the current token, without consuming any tokens.
+*/
+std::vector<std::string> Parser::upcoming_includes() {
+	std::vector<std::string> filenames;
+	Lexer ahead = lexer;
+	Token token = peek;
+	while (token.token_type == STRING) {
+		filenames.push_back(token.text());
+		token = ahead.next_token();
+		while (token.token_type == NEWLINE)
+			token = ahead.next_token();
+	}
+	return filenames;
+}
+
+/*
+Parses an included file on its own, seeing the symbols that parent had when the include section started. Nothing is added to
+the DSMInfo; the contents of the file are only recorded in parsed. Returns false if the file contains an error.
+*/
+bool Parser::parse_speculatively(std::string filename, const SymbolTable &parent, ParsedFile &parsed) {
+	SymbolTable symbol_table;
+	symbol_table.inherit(parent);
+	symbol_table.recordings.push_back(&parsed);
+	DSMInfoBuilder builder;
+
+	RomImage file;
+	symbol_table.open_source_file(file, filename);
+	Parser parser((const char *)file.data(), (const char *)file.data() + file.size(), filename, symbol_table, builder);
+	try {
+		parser.file();
+	}
+	catch (parse_error &) {
+		return false;
+	}
+	parsed.known_symbols.clear();
+	return true;
+}
+
+/*
+Parses the files of the include section that starts at the current token in parallel and adds the results to the parsed files.
+Files are parsed independently of each other, so a result is only used by include_section() if the symbols that the file took
+from other files still have the same values when it is reached. Otherwise the file is parsed again.
+*/
+void Parser::parse_includes_in_parallel() {
+	std::vector<std::string> filenames;
+	for (const std::string &filename : upcoming_includes()) {
+		if (symbol_table.parsed_files.find(filename) == symbol_table.parsed_files.end()
+			&& std::find(filenames.begin(), filenames.end(), filename) == filenames.end())
+		{
+			//Files from the cache do not have to be parsed
+			RomImage file;
+			ParsedFile parsed;
+			if (symbol_table.cache && symbol_table.open_source_file(file, filename) && load_stored_file(file, filename, parsed))
+				symbol_table.parsed_files[filename] = std::move(parsed);
+			else
+				filenames.push_back(filename);
+		}
+	}
+	if (filenames.size() < 2)
+		return;
+
+	std::vector<ParsedFile> results(filenames.size());
+	std::vector<uint8_t> succeeded(filenames.size(), false);
+	std::atomic<size_t> next_file(0);
+	auto parse_files = [&]() {
+		size_t i;
+		while ((i = next_file++) < filenames.size())
+			succeeded[i] = parse_speculatively(filenames[i], symbol_table, results[i]);
+	};
+
+	unsigned int threads = (unsigned int)std::min((size_t)symbol_table.threads, filenames.size());
+	std::vector<std::thread> workers;
+	for (unsigned int t = 1; t < threads; t++)
+		workers.push_back(std::thread(parse_files));
+	parse_files();
+	for (std::thread &w : workers)
+		w.join();
+
+	for (size_t i = 0; i < filenames.size(); i++) {
+		if (succeeded[i]) {
+			store_parsed_file(filenames[i], results[i]);
+			symbol_table.parsed_files[filenames[i]] = std::move(results[i]);
+		}
+	}
+}
+
 void Parser::segments_section() {
 	while (peek.token_type == LITERAL
 		|| peek.token_type == LEFT_PARENTHESES
@@ -115,13 +425,12 @@ void Parser::segments_section() {
 		if (peek.token_type != IDENTIFIER)
 			type = read_data_type();
 
-		std::string identifier = consume().lexem;
+		std::string identifier = consume().text();
 
 		match_newline();
 		skip_blank_lines();
 
-		info.add_segment(identifier, type, target.first, target.second);
-		symbol_table.add_symbol(identifier, target.first);
+		add_entry(LabelFileEntry(SEGMENT_ENTRY, identifier, type, target.first, target.second));
 	}
 }
 
@@ -136,17 +445,15 @@ void Parser::labels_section() {
 		if (peek.token_type != IDENTIFIER)
 			type = read_data_type();
 
-		std::string identifier = consume().lexem;
+		std::string identifier = consume().text();
 
 		match_newline();
 		skip_blank_lines();
 
 		if (target.first != target.second)
-			info.add_range_label(identifier, target.first, target.second, type);
+			add_entry(LabelFileEntry(RANGE_LABEL_ENTRY, identifier, type, target.first, target.second));
 		else
-			info.add_label(identifier, target.first, type);
-
-		symbol_table.add_symbol(identifier, target.first);
+			add_entry(LabelFileEntry(LABEL_ENTRY, identifier, type, target.first, target.first));
 	}
 }
 
@@ -156,12 +463,12 @@ void Parser::comments_section() {
 		|| peek.token_type == IDENTIFIER)
 	{
 		int address = address_expr();
-		std::string comment = match(STRING).lexem;
+		std::string comment = match(STRING).text();
 
 		match_newline();
 		skip_blank_lines();
 
-		info.add_comment(comment, address);
+		add_entry(LabelFileEntry(COMMENT_ENTRY, comment, UNDEFINED_T, address, address));
 	}
 }
 
@@ -271,7 +578,7 @@ int Parser::address_product() {
 }
 
 int Parser::single_address() {
-	std::string lexem = peek.lexem;
+	std::string lexem = peek.text();
 	int val = 0;
 	switch (consume().token_type) {
 	case SUBTRACT:
@@ -303,8 +610,66 @@ int Parser::single_address() {
 	}
 }
 
-void Parser::parse(std::istream &in, std::string source, DSMInfo &info) {
+bool Parser::parse(std::string source,
+	DSMInfo &info,
+	std::function<void(const std::string &)> file_read,
+	unsigned int threads,
+	std::unordered_map<std::string, ParsedFile> *parsed_files,
+	const CacheDirectory *cache)
+{
 	SymbolTable symbol_table;
-	Parser parser(in, source, symbol_table, info);
-	parser.file();
+	symbol_table.file_read = file_read;
+	symbol_table.threads = threads;
+	symbol_table.cache = cache;
+	if (parsed_files)
+		symbol_table.parsed_files.swap(*parsed_files);
+
+	//The label file itself is handled like an included file, so it is only parsed if it is not among the parsed files
+	DSMInfoBuilder builder;
+	Parser parser(nullptr, nullptr, source, symbol_table, builder);
+	bool found = true;
+	try {
+		auto cached = symbol_table.parsed_files.find(source);
+		bool in_memory = cached != symbol_table.parsed_files.end();
+		if (!in_memory || !parser.reuse_parsed_file(cached->second)) {
+			RomImage file;
+			found = symbol_table.open_source_file(file, source);
+			if (found && (in_memory || !parser.reuse_stored_file(file, source)))
+				parser.parse_file(file, source);
+		}
+	}
+	catch (parse_error &) {
+		//Files that were parsed completely stay valid
+		if (parsed_files)
+			symbol_table.parsed_files.swap(*parsed_files);
+		throw;
+	}
+	if (parsed_files)
+		symbol_table.parsed_files.swap(*parsed_files);
+	if (!found)
+		return false;
+
+	//Entries from all files are added at once
+	try {
+		builder.build(info);
+	}
+	catch (std::invalid_argument &e) {
+		std::cerr << "Error in file " << source << ":" << std::endl;
+		std::cerr << "\t" << e.what() << std::endl;
+		throw parse_error();
+	}
+	return true;
 }
+
+
+void Parser::forget_files(std::unordered_map<std::string, ParsedFile> &parsed_files, const std::vector<std::string> &files) {
+	for (auto it = parsed_files.begin(); it != parsed_files.end();) {
+		bool changed = false;
+		for (const std::string &file : it->second.files)
+			changed = changed || std::find(files.begin(), files.end(), file) != files.end();
+		if (changed)
+			it = parsed_files.erase(it);
+		else
+			++it;
+	}
+}
\ No newline at end of file
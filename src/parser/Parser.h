@@ -1,12 +1,15 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <istream>
+#include <functional>
 #include <stdexcept>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include "Lexer.h"
+#include "../CacheDirectory.h"
 #include "../DSMInfo.h"
+#include "../RomImage.h"
 
 /*
 Label file grammar:
@@ -44,23 +47,100 @@ public:
 	}
 };
 
+enum entry_kind {
+	SEGMENT_ENTRY, LABEL_ENTRY, RANGE_LABEL_ENTRY, COMMENT_ENTRY
+};
+
+/*
+An entry of a label file that gets added to the DSMInfo. Segments and labels also define a symbol.
+*/
+struct LabelFileEntry {
+	entry_kind kind;
+	std::string text;	//Name of the segment or label, or text of the comment
+	data_type type;
+	unsigned int start_address;
+	unsigned int end_address;
+
+	LabelFileEntry(entry_kind kind, std::string text, data_type type, unsigned int start_address, unsigned int end_address) :
+		kind(kind),
+		text(text),
+		type(type),
+		start_address(start_address),
+		end_address(end_address) {}
+};
+
+/*
+The result of parsing a label file and the files it includes. When the same file is read again, its entries are added again
+instead of parsing the file, as long as the symbols it took from other files still have the same values.
+Parsed files can also be stored in a CacheDirectory, where they are found by the name and contents of the file, and only used if
+the files it includes still have the same contents.
+*/
+struct ParsedFile {
+	std::vector<std::string> files;	//The file itself and all files it includes, in the order they were parsed
+	std::vector<uint64_t> hashes;	//Hashes of the contents of files. Only computed if a CacheDirectory is used.
+	std::vector<LabelFileEntry> entries;
+	std::vector<std::pair<std::string, int>> external_symbols;	//Symbols that were used before the file defined them, with their values
+
+	//Symbols that were defined by the file or recorded as external. Only used while the file is parsed.
+	std::unordered_set<std::string> known_symbols;
+};
+
 class SymbolTable {
 
 	std::vector<std::string> source_files;
 	std::unordered_map<std::string, int> symbols;
 
+	//Symbols of the SymbolTable that started a speculative parse. Only read, and only while the speculative parse runs.
+	const std::unordered_map<std::string, int> *inherited_symbols = nullptr;
+
 public:
+	//If set, parsed files are looked up in and stored to this cache
+	const CacheDirectory *cache = nullptr;
+
+	//If set, called with the name of every file right before it gets read, and for files whose recorded contents are reused.
+	//Speculative parses call it from their own threads.
+	std::function<void(const std::string &)> file_read;
+
+	//Number of threads used to parse the files of an include section
+	unsigned int threads = 1;
+
+	//Errors are not reported during speculative parses, since the file gets parsed again if the speculative parse fails
+	bool report_errors = true;
+
+	//Label files that have been parsed completely, by file name
+	std::unordered_map<std::string, ParsedFile> parsed_files;
+
+	//Included files that are being parsed, innermost last. Everything the parser does is recorded in all of them.
+	std::vector<ParsedFile *> recordings;
+
 	int get_symbol_value(std::string identifier);
 	void add_symbol(std::string symbol, int value);
 
-	void enter_source_file(std::string source) {
+	void enter_source_file(std::string source, uint64_t hash) {
 		source_files.push_back(source);
+		for (ParsedFile *recording : recordings) {
+			recording->files.push_back(source);
+			recording->hashes.push_back(hash);
+		}
 	}
 
 	void leave_source_file() {
 		source_files.pop_back();
 	}
 
+	bool open_source_file(RomImage &file, const std::string &source) const;
+
+	/*
+	Prepares this SymbolTable for a speculative parse, which sees the symbols and the current source files of parent.
+	*/
+	void inherit(const SymbolTable &parent) {
+		source_files = parent.source_files;
+		inherited_symbols = &parent.symbols;
+		file_read = parent.file_read;
+		cache = parent.cache;
+		report_errors = false;
+	}
+
 	bool is_source_file_loaded(std::string source) {
 		for (std::string s : source_files) {
 			if (s == source)
@@ -73,13 +153,16 @@ public:
 class Parser {
 
 	std::string source;
-	DSMInfo &info;
+	DSMInfoBuilder &info;
 
 	Lexer lexer;
-	Token peek = Token(EOI, "");
+	Token peek = Token(EOI);
 
 	SymbolTable &symbol_table;
 
+	//Hash of the contents of the file, if the SymbolTable has a CacheDirectory
+	uint64_t content_hash = 0;
+
 	void file();
 	void section();
 	void include_section();
@@ -87,6 +170,15 @@ class Parser {
 	void labels_section();
 	data_type read_data_type();
 	void comments_section();
+	void add_entry(const LabelFileEntry &entry);
+	void parse_file(const RomImage &file, const std::string &filename);
+	bool reuse_parsed_file(const ParsedFile &parsed);
+	bool load_stored_file(const RomImage &file, const std::string &filename, ParsedFile &parsed);
+	bool reuse_stored_file(const RomImage &file, const std::string &filename);
+	void store_parsed_file(const std::string &filename, const ParsedFile &parsed);
+	std::vector<std::string> upcoming_includes();
+	void parse_includes_in_parallel();
+	static bool parse_speculatively(std::string filename, const SymbolTable &parent, ParsedFile &parsed);
 	std::pair<unsigned int, unsigned int> label_target();
 	int address_expr();
 	int address_product();
@@ -98,19 +190,30 @@ class Parser {
 	Token consume();
 	void skip_blank_lines();
 
-	Parser(std::istream &in, std::string source, SymbolTable &symbol_table, DSMInfo &info)
-		: source(source),
-		  info(info),
-		  lexer(Lexer(in)),
-		  symbol_table(symbol_table)
-	{
-		peek = lexer.next_token();
-	}
+	Parser(const char *begin, const char *end, std::string source, SymbolTable &symbol_table, DSMInfoBuilder &info);
 
 public:
-	static void parse(std::istream &in,
-		std::string source,
-		DSMInfo &info);
+	/*
+	Parses a label file and all files it includes, and adds their contents to info. The files are memory-mapped where possible.
+	file_read is called with the name of every file, starting with source, right before the file is read, even if parsing fails.
+	The files of an include section are parsed in parallel using up to the given number of threads. The result is the same as if
+	they were parsed one after another.
+	If parsed_files is given, files that are found in it are not parsed again, and all files that are parsed completely are added
+	to it, even if parsing fails later on. Files that changed since have to be removed with forget_files().
+	If cache is given, files that are not in parsed_files are looked up in the cache, and files that get parsed are stored in it.
+	Returns false if the file could not be opened.
+	*/
+	static bool parse(std::string source,
+		DSMInfo &info,
+		std::function<void(const std::string &)> file_read = nullptr,
+		unsigned int threads = 1,
+		std::unordered_map<std::string, ParsedFile> *parsed_files = nullptr,
+		const CacheDirectory *cache = nullptr);
+
+	/*
+	Removes the parsed files that were read from any of the given files, including the files that include them.
+	*/
+	static void forget_files(std::unordered_map<std::string, ParsedFile> &parsed_files, const std::vector<std::string> &files);
 };
 
 #endif
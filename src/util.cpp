@@ -6,7 +6,7 @@
 #define DECIMAL 10
 #define HEXADECIMAL 16
 
-const char hex_digits[] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
+const char hex_digits[16] = { '0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f' };
 
 /*
 Converts an int literal to an int. The base is selected based on the form of the input string.
@@ -3,6 +3,9 @@
 
 #include <string>
 
+//Lower case hexadecimal digits
+extern const char hex_digits[16];
+
 int parse_int_literal(std::string str);
 
 std::string hex16bit(const int v);
@@ -0,0 +1,62 @@
+#include <cstring>
+#include <string>
+
+#include "../src/parser/Lexer.h"
+#include "Test.h"
+
+/*
+Lexes a string and returns the first token.
+*/
+static Token first_token(const char *text) {
+	Lexer lexer(text, text + std::strlen(text));
+	return lexer.next_token();
+}
+
+static void test_plain_string_is_not_copied() {
+	const char *text = "\"plain string\"\n";
+	Token token = first_token(text);
+	CHECK_EQUAL(token.token_type, STRING);
+	CHECK(token.lexem == text + 1);
+	CHECK_EQUAL(token.length, 12u);
+	CHECK(token.copy.empty());
+	CHECK_EQUAL(token.text(), "plain string");
+}
+
+static void test_escaped_string_is_copied() {
+	const char *text = "\"a \\\"b\\\"\"\n";
+	Token token = first_token(text);
+	CHECK_EQUAL(token.token_type, STRING);
+	CHECK(token.lexem == nullptr);
+	CHECK_EQUAL(token.text(), "a \"b\"");
+}
+
+static void test_empty_string() {
+	Token token = first_token("\"\"\n");
+	CHECK_EQUAL(token.token_type, STRING);
+	CHECK_EQUAL(token.text(), "");
+}
+
+static void test_unterminated_string() {
+	Token token = first_token("\"abc");
+	CHECK_EQUAL(token.token_type, ERROR);
+}
+
+static void test_tokens_after_string() {
+	const char *text = "\"abc\" code\n";
+	Lexer lexer(text, text + std::strlen(text));
+	CHECK_EQUAL(lexer.next_token().text(), "abc");
+	Token token = lexer.next_token();
+	CHECK_EQUAL(token.token_type, CODE);
+	CHECK(token.lexem == text + 6);
+	CHECK_EQUAL(lexer.next_token().token_type, NEWLINE);
+	CHECK_EQUAL(lexer.next_token().token_type, EOI);
+}
+
+int main() {
+	test_plain_string_is_not_copied();
+	test_escaped_string_is_copied();
+	test_empty_string();
+	test_unterminated_string();
+	test_tokens_after_string();
+	return TEST_RESULT;
+}
\ No newline at end of file
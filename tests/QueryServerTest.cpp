@@ -0,0 +1,62 @@
+#include <sstream>
+#include <string>
+
+#include "../src/QueryServer.h"
+#include "Test.h"
+
+/*
+Answers a single request about a disassembly without lines that only has the given labels, and returns the response.
+*/
+static std::string query(DSMInfo &info, const std::string &request) {
+	AssemblyLines lines;
+	XrefIndex xrefs;
+	xrefs.build(lines);
+	QueryServer server(lines, info, xrefs, [](size_t, size_t, ListingBuffer &) {});
+
+	std::istringstream in(request + "\n");
+	std::ostringstream out;
+	server.serve(in, out);
+	return out.str();
+}
+
+static void test_control_escapes() {
+	DSMInfo info;
+	info.compile();
+	//The id is copied to the response, where control characters other than \n, \r and \t are written as \u escapes
+	CHECK_EQUAL(query(info, "{\"id\":\"a\\bb\\fc\",\"query\":\"none\"}"),
+		"{\"id\":\"a\\u0008b\\u000cc\",\"ok\":false,\"error\":\"Unknown query: none\"}\n");
+}
+
+static void test_unicode_escapes() {
+	DSMInfo info;
+	info.compile();
+	CHECK_EQUAL(query(info, "{\"id\":\"\\u00e9\\u0141\\ud83d\\ude00\",\"query\":\"none\"}"),
+		"{\"id\":\"\xc3\xa9\xc5\x81\xf0\x9f\x98\x80\",\"ok\":false,\"error\":\"Unknown query: none\"}\n");
+}
+
+static void test_unicode_escape_does_not_alias_label() {
+	DSMInfo info;
+	info.add_label("Abc", 0x100, CODE_T);
+	info.compile();
+	CHECK_EQUAL(query(info, "{\"query\":\"label\",\"name\":\"Abc\"}"), "{\"ok\":true,\"address\":256}\n");
+	//U+0141 used to be cut down to its low byte 0x41, which is 'A'
+	CHECK_EQUAL(query(info, "{\"query\":\"label\",\"name\":\"\\u0141bc\"}"), "{\"ok\":false,\"error\":\"Unknown label\"}\n");
+}
+
+static void test_unpaired_surrogates() {
+	DSMInfo info;
+	info.compile();
+	const std::string malformed = "{\"ok\":false,\"error\":\"Malformed request\"}\n";
+	CHECK_EQUAL(query(info, "{\"query\":\"label\",\"name\":\"\\ud83d\"}"), malformed);
+	CHECK_EQUAL(query(info, "{\"query\":\"label\",\"name\":\"\\ud83dx\"}"), malformed);
+	CHECK_EQUAL(query(info, "{\"query\":\"label\",\"name\":\"\\ud83d\\u0041\"}"), malformed);
+	CHECK_EQUAL(query(info, "{\"query\":\"label\",\"name\":\"\\ude00\"}"), malformed);
+}
+
+int main() {
+	test_control_escapes();
+	test_unicode_escapes();
+	test_unicode_escape_does_not_alias_label();
+	test_unpaired_surrogates();
+	return TEST_RESULT;
+}
\ No newline at end of file
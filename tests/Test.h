@@ -0,0 +1,31 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <iostream>
+
+/*
+Minimal checks for the test programs. A failed check is reported with its location, and the program returns the number of
+failed checks through TEST_RESULT.
+*/
+static int failed_checks = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": Check failed: " #condition << std::endl; \
+			failed_checks++; \
+		} \
+	} while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+	do { \
+		if (!((actual) == (expected))) { \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": Check failed: " #actual " == " #expected \
+				<< "\n\tactual:   " << (actual) << "\n\texpected: " << (expected) << std::endl; \
+			failed_checks++; \
+		} \
+	} while (0)
+
+#define TEST_RESULT (failed_checks == 0 ? 0 : 1)
+
+#endif
\ No newline at end of file